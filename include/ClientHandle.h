@@ -0,0 +1,67 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef ClientHandle_h
+#define ClientHandle_h
+
+#include <Arduino.h>
+#include "NetworkConfig.h"
+
+/**
+ * @brief A client handle identifies a connection across all transports of the NetworkStation. 
+ * It is send as DccMessage::client to the CommandStation and comes back unchanged with the reply.
+ * The handle has to fit into a positive 16 bit int as int is 16 bit on the AVR side:
+ * 
+ *  bits  0 -  3 : slot of the connection in the connection pool of the transport
+ *  bits  4 -  6 : transport id as returned by DCCNetwork::add ( 1 based; 0 is no transport )
+ *  bits  7 - 14 : generation of the slot; incremented each time a new client takes the slot 
+ *                 so that replies for a previous client of that slot are rejected
+ */
+#define CH_SLOT_BITS        4
+#define CH_TRANSPORT_BITS   3
+#define CH_GEN_BITS         8
+
+static_assert(MAX_SOCK_NUM <= (1 << CH_SLOT_BITS), "MAX_SOCK_NUM doesn't fit into the client handle");
+static_assert(MAX_INTERFACES < (1 << CH_TRANSPORT_BITS), "MAX_INTERFACES doesn't fit into the client handle");
+
+struct ClientHandle
+{
+    static uint16_t make(uint8_t transport, uint8_t slot, uint8_t gen) {
+        return (uint16_t) (slot & ((1 << CH_SLOT_BITS) - 1))
+             | (uint16_t) (transport & ((1 << CH_TRANSPORT_BITS) - 1)) << CH_SLOT_BITS
+             | (uint16_t) gen << (CH_SLOT_BITS + CH_TRANSPORT_BITS);
+    }
+    static uint8_t slot(uint16_t h) {
+        return h & ((1 << CH_SLOT_BITS) - 1);
+    }
+    static uint8_t transport(uint16_t h) {
+        return (h >> CH_SLOT_BITS) & ((1 << CH_TRANSPORT_BITS) - 1);
+    }
+    static uint8_t generation(uint16_t h) {
+        return (h >> (CH_SLOT_BITS + CH_TRANSPORT_BITS)) & ((1 << CH_GEN_BITS) - 1);
+    }
+    /**
+     * @brief next generation for a slot; 0 is never used so that a handle of 0 is never valid
+     */
+    static uint8_t next(uint8_t gen) {
+        return (gen == 255) ? 1 : gen + 1;
+    }
+};
+
+#endif
@@ -86,9 +86,10 @@ private:
     char *end;
     const char *tmp;
     scanType currentCmdType = UNDEFINED;
+    scanType pinned = UNDEFINED;            // protocol fixed by the port the data has been recieved on; UNDEFINED if it has to be detected
     
     void (*callback)(scanType s, char * buffer);
-    char overflow[MAX_MESSAGE_SIZE/2] = {'\0'}; 
+    char *rest;                             // start of an incomplete command at the end of the scanned buffer
 
     scanState stateStartScan();
     scanState stateOverflow();
@@ -117,7 +118,23 @@ public:
         } // The char c never appears in any of the start_t arrays;
         return token[UNDEFINED];
     }
-    void scanCommands(char *in, const int len, void (*handler)(scanType s, char * buffer) );
+    /**
+     * @brief as findScanType but only for the pinned protocol. WiThrottle and HTTP are line based so 
+     * any non blank char starts a command; the others still need their start token
+     */
+    CommandToken *findPinnedScanType (char c){
+        CommandToken *ct = token[pinned];
+        if (pinned == WITHROTTLE || pinned == HTTP) {
+            return isspace(c) ? token[UNDEFINED] : ct;
+        }
+        return strchr(ct->getStartToken()->c_str(), c) ? ct : token[UNDEFINED];
+    }
+    /**
+     * @brief scans len bytes of in for commands and calls the handler for each of them. The commands are handed over in place
+     * so in[len] must be writable. Returns the number of bytes consumed; the bytes after that are the start of an incomplete 
+     * command which has to be scanned again together with the bytes following it.
+     */
+    int scanCommands(char *in, const int len, void (*handler)(scanType s, char * buffer), scanType protocol = UNDEFINED);
     
     // static void testScan();
 
@@ -32,6 +32,10 @@
 #define DCC_SSID  "DeepSpace"
 #define DCC_WPWD  "qsdfghjklm!"
 
+#define MQTT_BROKER "10.0.0.1"      // e.g. mosquitto running on the development machine
+#define MQTT_USER   nullptr         // nullptr for brokers allowing anonymous access
+#define MQTT_PWD    nullptr
+
 
 #define dccexcom 0    // build dccex integration
 #define netdiag 0     // enable diagnotics to be send to a network client
@@ -0,0 +1,87 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef Correlator_h
+#define Correlator_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+
+#include "DccExInterface.h"
+
+/**
+ * @brief Latencies in logarithmic buckets: bucket 0 counts what took less than 1ms, bucket i what took
+ * [2^(i-1), 2^i) ms and the last one everything longer
+ */
+struct LatencyHistogram
+{
+    uint32_t buckets[DCCI_LATENCY_BUCKETS] = {0};
+    uint32_t count = 0;
+    uint32_t max = 0;                   // us
+
+    void add(uint32_t us);
+    void print(const char *name);
+};
+
+/**
+ * @brief A command send to the CommandStation waiting for its reply
+ */
+struct Correlation
+{
+    bool     used;
+    uint16_t mid;
+    uint16_t client;                    // client the reply goes to
+    char     opcode;
+    byte     lane;                      // command class the latencies are counted for
+    uint32_t sentAt;                    // micros() the command has been send the first time
+    bool     acked;                     // the CommandStation has acknowledged it on the link
+};
+
+/**
+ * @brief Matches the replies of the CommandStation to the commands which caused them. Each command send over
+ * the serial link is entered with its mid; the CommandStation returns that mid in DccMessage::rid of its reply.
+ * Per command class (the lanes of the queues) two histograms are kept:
+ *   link  - send until acknowledged by the other station, i.e. the serial link and the queues of the CS
+ *   reply - send until the reply has been recieved, i.e. the link plus the execution on the CS
+ * A command without reply after DCCI_REPLY_TIMEOUT ms is counted as timed out and removed.
+ */
+class Correlator
+{
+private:
+    static Correlation      table[DCCI_CORRELATIONS];
+    static LatencyHistogram link[DCCI_LANES];
+    static LatencyHistogram reply[DCCI_LANES];
+
+public:
+    static uint32_t timeouts[DCCI_LANES];
+    static uint32_t evicted;            // entries overwritten by a new command as the table was full
+    static uint32_t unmatched;          // replies without an entry
+
+    static void sent(DccMessage &m);                // a command has been send the first time
+    static void acked(uint16_t mid);                // it has been acknowledged
+    static uint16_t replied(DccMessage &m);         // returns the client the reply goes to
+    static byte pending();                          // commands waiting for their reply
+    static bool isCommand(DccMessage &m);           // a message the CommandStation replies to
+    static void loop();                             // removes the entries which timed out
+    static void clear();                            // the CommandStation restarted; no reply will come
+    static byte cancel(byte lane);                  // the CommandStation drops the commands of the lane not yet executed
+    static void printStats();
+};
+
+#endif
@@ -30,7 +30,60 @@
 // #define DCCI_CS true   // set to true if compiles for the commandstation
 
 
-#define MAX_QUEUE_SIZE 10
+#define DCCI_URGENT_RETRY  20     // ms after which an emergency stop / power off not acknowledged is send again
+#define DCCI_URGENT_TRIES  5
+
+#define DCCI_LANES         4                // priority lanes of the queues: control, throttle, accessory, programming/diagnostic
+#define DCCI_LANE_CAPACITY {2, 4, 3, 3}      // messages each lane can hold
+#define DCCI_LANE_SLOTS    12               // sum of the lane capacities
+#define DCCI_FAIR_CLIENTS  8                // NetworkStation: clients with messages waiting for the outgoing queue at the same time
+#define DCCI_CLIENT_CAPACITY 4              // messages each of them may have waiting; only that client's commands are refused beyond
 #define MAX_MESSAGE_SIZE 64
 
+#define DCCI_BINARY      false  // send commands and replies which have one in their binary form (see DccExCodec.h); both 
+                                // stations always decode it so this can be set on either side independently
+
+#define DCCI_WINDOW      4      // max messages per link send and not yet acknowledged by the other station; 1 for stop and wait
+#define DCCI_RTO         100    // ms after which the messages not acknowledged are send again
+#define DCCI_ACK_DELAY   5      // ms an acknowledgement waits for a message to be piggybacked on before it is send on its own
+#define DCCI_RESET_RETRY 200    // ms after which the link reset send at setup is send again until the other station answers
+
+#define DCCI_RX_EVENTS       true // ESP32: frames are decoded in the UART event task as soon as they arrive instead of in the loop
+#define DCCI_RX_RING         2048 // bytes the UART driver buffers between its interrupt and the event task
+#define DCCI_RX_QUEUE        16   // decoded messages waiting to be processed by the loop
+
+#define DCCI_MAX_LINKS       3    // links used as one channel; see DccExInterface::addLink(). The window grows with the links
+#define DCCI_RING            (DCCI_WINDOW * DCCI_MAX_LINKS)   // messages in flight or held for reordering with all links in use
+#define DCCI_LINK_RING       1024 // bytes buffered each way by the SPI, I2C and loopback links
+#define DCCI_SPI_FRAME       64   // bytes clocked per SPI transaction; multiple of 4 for the DMA
+#define DCCI_SPI_MOSI        35   // SPI and I2C pins of the link; adjust to the wiring, they must not collide with
+#define DCCI_SPI_MISO        32   // the Ethernet PHY (ESP32-POE-ISO: 12, 17-27), the display (2, 5, 14, 15) or the
+#define DCCI_SPI_SCLK        36   // Wire bus of its touch controller (SDA 13, SCL 16); a link on SDA or SCL isn't started.
+#define DCCI_SPI_CS          39   // The master drives MOSI, SCLK and CS so input only pins do
+#define DCCI_SPI_HANDSHAKE   33   // high while the NetworkStation has data for the master
+#define DCCI_I2C_ADDRESS     0x42
+#define DCCI_I2C_SDA         4    // shares 32 with the SPI link; only one of them can be wired
+#define DCCI_I2C_SCL         32
+#define DCCI_I2C_FRAME       32   // bytes read by the master at once; the Wire buffer holds 128
+
+#define DCCI_NEGOTIATE       true // the NetworkStation steps the speed of the (first) UART link up at startup
+#define DCCI_SPEEDS          {115200, 250000, 500000, 1000000}   // tried in this order; exact on the 16MHz AVR with U2X
+#define DCCI_TEST_FRAMES     50   // test frames send at each speed
+#define DCCI_NEGO_TIMEOUT    500  // ms without an answer after which a speed counts as failed
+#define DCCI_NEGO_SETTLE     10   // ms after switching before the test frames are send
+#define DCCI_KEEPALIVE       1000 // ms without anything send after which an acknowledgement is send to show the link is alive
+#define DCCI_LINK_SILENCE    3000 // ms without a valid frame after which both stations fall back to the speed they started with
+#define DCCI_RTO_FAILS       5    // retransmits in a row without progress after which the same happens
+
+#define DCCI_BLOCKING        false // true: one command at a time waits for its reply (programming track); false: pipelined
+#define DCCI_PIPELINE        8    // commands waiting for their reply in pipelined mode; <= DCCI_CORRELATIONS
+#define DCCI_CORRELATIONS    16  // commands send to the CS waiting for their reply; the oldest is dropped if more are waiting
+#define DCCI_REPLY_TIMEOUT   2000 // ms after which a command without reply is counted as timed out
+#define DCCI_LATENCY_BUCKETS 12   // <1ms, <2ms, <4ms ... <1024ms, longer
+
+#define DCCI_BATCH_MAX   8      // messages packed into one serial frame; 1 for one frame per message
+#define DCCI_BATCH_BYTES 112    // max payload of a batch frame; with the frame overhead it has to fit into
+                                // MSGPACK_MAX_PACKET_BYTE_SIZE of the reciever (128 by default on AVR)
+#define DCCI_BATCH_DELAY 0      // ms a batch which isn't full may wait for more messages; 0 sends what is queued each loop
+
 #endif
\ No newline at end of file
@@ -40,6 +40,7 @@ extern "C" char *sbrk(int);
 extern char *__brkval;
 extern char *__malloc_heap_start;
 #elif defined(ARDUINO_ARCH_ESP32)
+#elif defined(DCCI_NATIVE)              // host build of the link code; see [env:native]
 #else
 #error Unsupported board type
 #endif
@@ -54,6 +55,8 @@ static inline int freeMemory()
     return __brkval ? &top - __brkval : &top - __malloc_heap_start;
 #elif defined(ARDUINO_ARCH_ESP32)
     return  ESP.getFreeHeap();
+#elif defined(DCCI_NATIVE)
+    return 0;
 #else
 #error bailed out already above
 #endif
@@ -0,0 +1,61 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef DccExCodec_h
+#define DccExCodec_h
+
+#include <Arduino.h>
+
+#define DCCOP_MAX_PARAMS 6          // max number of parameters of a command with a binary form
+
+/**
+ * @brief A DCC-EX command or reply as the CommandStation parser sees it: the opcode and the
+ * numeric parameters
+ */
+struct DccOp
+{
+    char opcode;
+    uint8_t n;                      // number of parameters
+    int p[DCCOP_MAX_PARAMS];
+};
+
+/**
+ * @brief Binary form of the frequent DCC-EX commands and replies (throttle, function, turnout,
+ * power, sensor, loco state) for the serial link between the stations.
+ *
+ * A command like <t 1 3 50 1> becomes one opcode byte (0x80 | index in the opcode table) followed by the
+ * parameters as zigzag varints in base 127: digits 0..126 are send as 0x80 + digit if more digits follow
+ * and as digit + 1 for the last one. The binary form never contains a 0 byte, so it travels in the payload
+ * of a DccMessage like text; its first byte is >= 0x80 whereas text starts with '<' or another ASCII character.
+ * Only commands which render back to exactly the same text are encoded; everything else stays text.
+ */
+class DccExCodec
+{
+public:
+    static bool isBinary(const char *msg) {
+        return (uint8_t) msg[0] >= 0x80;
+    }
+    static char opcode(const char *msg);                                // opcode of a command in text or binary form; 0 if none
+    static int  encode(const char *text, char *out, int size);          // binary form of text; 0 if text has none
+    static bool decode(const char *bin, uint8_t len, DccOp &op);        // false if bin is not a valid binary form
+    static bool parse(const char *text, DccOp &op);                     // <opcode p1 p2 ...> with numeric parameters only
+    static int  toText(const DccOp &op, char *out, int size);           // canonical text <opcode p1 p2 ...>
+};
+
+#endif
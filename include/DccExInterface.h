@@ -26,6 +26,13 @@
 #include <DCSIconfig.h>
 #include "MsgPacketizer.h"
 #include "Queue.h"
+#include "DccExCodec.h"
+#include "DccLink.h"
+#include "LinkNegotiator.h"
+
+#if defined(ARDUINO_ARCH_ESP32) && DCCI_RX_EVENTS
+#define DCCI_RX_ASYNC               // decoding runs in the UART event task; see DccExInterface::onRx()
+#endif
 
 /**
  * @brief comStation is used to identify the type of participant. In general there shall be only
@@ -42,17 +49,6 @@ typedef enum
 } comStation;
 // static_cast enum to int is ok as enum is implemented as int
 // static_cast int to enum works as well but invalid enum values will be accepted so needs sanity check
-/**
- * @brief "Hardware" elated protocols to comuunicate with a connected MCU. As of now 
- * only Serial is supported
- */
-typedef enum
-{
-    _SRL,        // serial
-    _I2C,        // i2c
-    _SPI,        // spi
-    _UNKNOWN_COM_PROTOCOL
-} comProtocol;
 /**
  * @brief the type of command going over the wire. only DCCEX / WITHROTTLE or Contol commands are allowed
  * the networkstation will function as MQTT & HTTP endpoint and only transmit the the DCCEX type commands
@@ -72,12 +68,12 @@ typedef enum
 } csProtocol;
 #endif
 #define HANDLERS  \
-    static void dccexHandler(DccMessage m); \
-    static void wiThrottleHandler(DccMessage m); \
-    static void notYetHandler(DccMessage m); \
-    static void replyHandler(DccMessage m); \
-    static void diagHandler(DccMessage m); \
-    static void ctrlHandler(DccMessage m);
+    static void dccexHandler(DccExInterface &dcci, DccMessage m); \
+    static void wiThrottleHandler(DccExInterface &dcci, DccMessage m); \
+    static void notYetHandler(DccExInterface &dcci, DccMessage m); \
+    static void replyHandler(DccExInterface &dcci, DccMessage m); \
+    static void diagHandler(DccExInterface &dcci, DccMessage m); \
+    static void ctrlHandler(DccExInterface &dcci, DccMessage m);
 
 #ifndef DCCI_CS
 #define HANDLER_INIT  \
@@ -90,9 +86,12 @@ typedef enum
 #endif
 //      _DCCEX          _WITHROTTLE,    _REPLY        _DIAG           _MQTT           _HTTP           _CTRL
 
+#define DCCI_MSG_BYTES (MAX_MESSAGE_SIZE + 32)     // upper bound of a packed DccMessage: array, six ints of at most 5 bytes, str header
+
 /**
  * @brief DccMessage is the struct serailazed and send over the 
- *        wire to either the command or network station
+ *        wire to either the command or network station. The payload is held inline so that 
+ *        creating, copying (queues, handlers) and sending a message doesn't touch the heap
  * 
  */
 class DccMessage {
@@ -100,19 +99,100 @@ public:
     int sta;                    // station allowed values are comming from the comStation enum 
                                 // but as msgpack doesn't really work on enums(?) 
     int mid;                    // message id; sequence number 
-    int client;                 // client id ( socket number from Wifi or Ethernet to be checked if we need to also have the original channel)
+    int client;                 // client handle of the NetworkStation ( transport, slot and generation see ClientHandle.h ); the CS sends it back unchanged
     int p;                      // either JMRI or WITHROTTLE in order to understand the content of the msg payload
-    MsgPack::str_t msg;         // going to CS this is a command and a reply on return
-    MSGPACK_DEFINE(sta, mid, client, p, msg);
+    int ack;                    // mid of the last message recieved in order from the other station; cumulative acknowledgement
+    int rid;                    // replies: mid of the command they answer
+    uint8_t len;                // length of msg without the terminating 0
+    char msg[MAX_MESSAGE_SIZE]; // going to CS this is a command and a reply on return; always 0 terminated
+
+    /**
+     * @brief copies s into the payload
+     * 
+     * @return false if s has been truncated to MAX_MESSAGE_SIZE - 1 characters
+     */
+    bool set(const char *s) {
+        size_t n = strlen(s);
+        bool fits = n < MAX_MESSAGE_SIZE;
+        len = fits ? n : MAX_MESSAGE_SIZE - 1;
+        memcpy(msg, s, len);
+        msg[len] = 0;
+        return fits;
+    }
+    // packed as the msgpack array [sta, mid, client, p, ack, rid, str] straight from / into the fields so that
+    // neither side needs a String or any other heap object for it
+    size_t packedSize() const;                  // bytes pack() writes
+    size_t pack(uint8_t *buffer) const;
+    size_t unpack(const uint8_t *data, size_t size);    // returns the bytes used; 0 if data doesn't hold a message
 
-    DccMessage() {
-        msg.reserve(MAX_MESSAGE_SIZE);        // reserve upfront space; requires that we check that no command exceeds MAX_MESSAGE_SIZE
-                                              // avoids heap memory fragmentation and the whole reciev send process runs in constant memory  
+    DccMessage() : sta(0), mid(0), client(0), p(0), ack(0), rid(0), len(0) {
+        msg[0] = 0;
     }
 }; 
 
-typedef Queue<DccMessage, MAX_QUEUE_SIZE> _tDccQueue;
-using  _tcsProtocolHandler = void (*)(DccMessage m);
+/**
+ * @brief Lanes of the queues in decreasing priority. A lane is only serviced if all the lanes above are empty
+ */
+typedef enum
+{
+    _LANE_CTRL,         // control messages, emergency stop and track power
+    _LANE_THROTTLE,     // speed and functions
+    _LANE_ACCESSORY,    // turnouts, outputs, sensors and everything not classified
+    _LANE_PROG          // programming track and diagnostics
+} dccLane;
+
+/**
+ * @brief What the UART event task has decoded; handed to the loop through a FreeRTOS queue so that the
+ * link state is only touched by the loop
+ */
+typedef enum
+{
+    _RX_MSG,            // message or message of a batch
+    _RX_ACK,            // acknowledgement in m.ack
+    _RX_URGENT,
+    _RX_URGENT_ACK,     // id in m.mid
+    _RX_NEGO,           // op, a, b of the link negotiation in m.mid, m.client, m.ack
+    _RX_RESET,          // epoch in m.mid
+    _RX_RESET_ACK,
+    _RX_TEST            // seq, w0, w1, crc of a test frame in m.mid, m.client, m.ack, m.rid
+} rxKind;
+
+struct DccRxEvent
+{
+    byte       kind;
+    uint32_t   at;                  // micros() the frame has been decoded
+    DccMessage m;
+};
+
+typedef LaneQueue<DccMessage, DCCI_LANES, DCCI_LANE_SLOTS> _tDccQueue;
+typedef FairQueue<DccMessage, DCCI_FAIR_CLIENTS, DCCI_CLIENT_CAPACITY> _tDccClientQueue;   // per client in front of the outgoing queue
+#if DCCI_BATCH_MAX > 15
+#error "DCCI_BATCH_MAX must fit into the fixarray header of a batch frame"
+#endif
+#if DCCI_BATCH_BYTES < DCCI_MSG_BYTES + 1
+#error "DCCI_BATCH_BYTES must hold at least one message"
+#endif
+
+/**
+ * @brief messages send together in one frame; packed into data as they are added. The frame is the msgpack 
+ * array of the messages; a frame of a single message is send without the array header
+ */
+class DccBatch
+{
+public:
+    uint8_t n = 0;                              // messages in the frame
+    size_t  size = 1;                           // bytes used including the array header
+    uint8_t data[DCCI_BATCH_BYTES];
+
+    bool add(const DccMessage &m);              // false if m doesn't fit anymore
+    void clear() {
+        n = 0;
+        size = 1;
+    }
+};
+class DccExInterface;
+using  _tcsProtocolHandler = void (*)(DccExInterface &dcci, DccMessage m);   // dcci is the interface the message came in on
+using  _tDccOpHandler = void (*)(DccMessage &m, DccOp &op);   // executes a decoded command on the CS without text parsing
 
 typedef enum
 {
@@ -125,19 +205,78 @@ class DccExInterface
 {
 private:
     comStation      sta = _UNKNOWN_STA;               // needs to be set at init; defines which side this is running either CS or NW
-    comProtocol     comp = _UNKNOWN_COM_PROTOCOL;      // sets the com protocol used between CS and NW; Only serial is supported right now 
-    HardwareSerial  *s;                               // valid only for Serial; this needs to be refacrored into subclasses 
-                                                      // instatated for specific protocols (maybe even at compile tme to reduce size)
+    comProtocol     comp = _UNKNOWN_COM_PROTOCOL;      // com protocol of the link between CS and NW
+    DccLink         *link = nullptr;                  // UART, SPI, I2C or loopback; see DccLink.h. Carries acknowledgements and retransmits
+    DccLink         *links[DCCI_MAX_LINKS];           // link and the links added; the messages are striped over them
+    byte            nLinks = 1;
+    byte            stripe(DccMessage &m);            // link of a message; the same for all messages of a client or loco
     uint32_t        speed;                           
     bool            init = false;
-    bool            blocking = true;                  // send immediatly & wait for reply from the CS if false all commands 
-                                                      // send will be queued and handled in the loop 
-    uint64_t        seq = 0;
+    bool            blocking = DCCI_BLOCKING;         // synchronous: a command is only send once the reply to the previous one is there
+                                                      // pipelined (false): up to pipeline commands wait for their reply
+    byte            pipeline = DCCI_PIPELINE;
+    bool            mayWrite(DccMessage &m);          // false if m is a command and the mode doesn't allow another one to be outstanding
+    uint16_t        seq = 0;                          // mid of the next message; mids wrap and are compared in serial arithmetic
     _tDccQueue      *incomming = nullptr;             // incomming queue holding message to be processed
     _tDccQueue      *outgoing = nullptr;              // outgoing queue holding message to be send 
+#ifndef DCCI_CS
+    _tDccClientQueue *clients = nullptr;              // messages of the clients waiting for the outgoing queue; drained round robin
+#endif
 
     void write();                                     // writes the messages from the outgoing queue to the com protocol endpoint (Serial only
                                                       // at this point
+    bool            binary = DCCI_BINARY;             // encode the commands / replies which have a binary form
+    _tDccOpHandler  opHandler = nullptr;              // if not set binary commands are handed to the handlers as text
+    bool            waiting = false;                  // messages are waiting in the outgoing queue for the batch to be send
+    uint32_t        since = 0;                        // millis() since when they are waiting
+
+    // sliding window; go back N with cumulative acknowledgements piggybacked on the messages
+    DccMessage      *unacked = nullptr;               // messages send and not yet acknowledged; ring of DCCI_RING
+    uint32_t        sentAt[DCCI_RING];                // millis() the message has been send (again)
+    byte            head = 0;                         // oldest message not acknowledged
+    byte            inFlight = 0;
+    byte            window = DCCI_WINDOW;             // messages per link which may be in flight; <= DCCI_WINDOW
+    uint16_t        expected = 0;                     // mid expected next from the other station
+    DccMessage      *held = nullptr;                  // messages recieved ahead of expected over another link; DCCI_RING
+    bool            ackPending = false;               // the other station waits for an acknowledgement
+    uint32_t        ackSince = 0;
+    uint32_t        txAt = 0;                         // millis() a message or an acknowledgement has been send last
+    byte            rtoFails = 0;                     // retransmits in a row without an acknowledgement in between
+    void            keepAlive();
+
+    // link reset; each station announces its start with a random epoch so that the other one restarts its sequence
+    uint16_t        epoch = 0;                        // of this station; never 0
+    uint16_t        peerEpoch = 0;                    // of the other station; 0 until its reset has been recieved
+    bool            synced = false;                   // the other station has answered our reset; no messages are send before
+    uint32_t        resetAt = 0;                      // millis() the reset has been send last
+    static uint16_t newEpoch();
+    void            resetRetry();
+
+    // emergency stop / power off; send out of band and acknowledged on their own
+    DccMessage      urgentMsg;                        // the last one; send again until acknowledged
+    bool            urgentPending = false;
+    byte            urgentTries = 0;
+    uint16_t        urgentId = 0;                     // id (mid) of the last one send
+    uint16_t        urgentRx = 0xFFFF;                // id of the last one recieved and executed
+    uint16_t        stopMid = 0;                      // seq of the other station when it send the last urgent message
+    bool            stopPending = false;              // throttle messages send before stopMid are still to be recieved
+    uint32_t        urgentSentAt = 0;                 // micros() of the first send
+
+#ifdef DCCI_RX_ASYNC
+    bool            rxAsync = false;                  // the link calls back from its driver task
+    QueueHandle_t   rxEvents = nullptr;               // DccRxEvent from the UART event task
+    static DccExInterface *rxOwner;                   // the interface fed by the UART event task; there is one decoder
+    static void     onRx();                           // runs in the UART event task
+    void            dispatch();                       // processes the decoded messages in the loop
+#endif
+
+    void received(DccMessage &m);                     // a message recieved; queued in order for recieve()
+    void onFrame(const uint8_t *data, size_t size, bool batch);
+    void urgentRetry();
+    void sendUrgent();
+    void send(DccBatch &batch, byte k = 0);           // one frame for the messages of the batch over links[k]
+    void retransmit();
+    void sendAck();
     const char* csProtocolNames[8] = {"DCCEX", "WTH", "REPLY", "DIAG", "MQTT" , "HTTP", "CTRL", "UNKNOWN"};   //TODO move that to Progmem
     const char* comStationNames[3] = {"CommandStation","NetworkStation","Unknown"};
     
@@ -147,6 +286,30 @@ private:
 public:
     const uint8_t recv_index = 0x34;
     const uint8_t send_index = 0x12;
+    const uint8_t batch_index = 0x35;                 // frames holding a DccBatch
+    const uint8_t ack_index = 0x36;                   // frames holding only an acknowledgement
+    const uint8_t urgent_index = 0x37;                // emergency stop / power off outside of the window and the queues
+    const uint8_t urgent_ack_index = 0x38;            // their acknowledgement
+    const uint8_t nego_index = 0x39;                  // link speed negotiation; see LinkNegotiator
+    const uint8_t test_index = 0x3A;                  // its test frames
+    const uint8_t reset_index = 0x3B;                 // a station has started; holds its epoch
+    const uint8_t reset_ack_index = 0x3C;             // the epoch of the reset recieved
+
+    uint32_t        retransmits = 0;                  // messages send again after DCCI_RTO
+    uint32_t        duplicates = 0;                   // messages recieved again and dropped
+    uint32_t        gaps = 0;                         // messages recieved out of order and dropped; they will be send again
+    uint32_t        restarts = 0;                     // resets recieved from the other station
+    uint32_t        lost = 0;                         // messages in flight to the other station when it restarted
+    uint32_t        refused = 0;                      // messages not queued as the queue of their client was full
+    uint32_t        reordered = 0;                    // messages recieved ahead of expected and held until it arrived
+    uint32_t        striped[DCCI_MAX_LINKS] = {0};    // messages send per link
+    uint32_t        urgents = 0;                      // emergency stops / power offs send
+    uint32_t        overtaken = 0;                    // throttle messages dropped as an urgent message has been send after them
+    uint32_t        urgentLatency = 0;                // us from the reception on the network to the write to the serial link of the last one
+    uint32_t        maxUrgentLatency = 0;
+    uint32_t        urgentAckLatency = 0;             // us from the write to the acknowledgement of the CS of the last one
+    uint32_t        rxOverruns = 0;                   // decoded messages lost as the loop didn't keep up; the window sends them again
+    uint32_t        rxMaxWait = 0;                    // us a decoded message waited for the loop at most
 
     auto getQueue(queueType q) -> _tDccQueue* {
         switch(q) {
@@ -162,7 +325,7 @@ public:
      * @param packet : DccMessage struct to be pushed and send over the wire 
      */
     void queue(queueType q, csProtocol p, DccMessage packet);
-    void queue(uint16_t c, csProtocol p, char *msg);
+    void queue(uint16_t c, csProtocol p, char *msg, int rid = 0);
     void recieve();        // check the transport to see if tere is something for us
     /**
      * @brief setup the serial interface 
@@ -171,23 +334,84 @@ public:
      * @param speed     - default serial speed is 115200
      */
     void setup(HardwareSerial *s = &Serial1, uint32_t speed = 115200);
+    /**
+     * @brief setup over any link
+     * 
+     * @param *l        - the link e.g. a SpiLink, I2cLink or LoopbackLink
+     * @param speed     - baud rate or bus clock of the link
+     */
+    void setup(DccLink *l, uint32_t speed);
+    /**
+     * @brief adds a link used together with the one given to setup(); to be called before setup() on both 
+     * stations with the links in the same order
+     */
+    bool addLink(DccLink *l);
+    void hold(DccMessage &m);                         // keeps a message recieved ahead of the one expected
+    void release();                                   // hands the held messages over which are next in order
     void setup(comStation station) {
         sta = station;                  // sets to network or commandstation mode
         setup();
     }
+    void setup(comStation station, DccLink *l, uint32_t speed = 0) {
+        sta = station;
+        setup(l, speed);
+    }
     void loop();
     auto size(queueType inout) -> size_t {
         if (inout == IN) {
             return incomming->size();
         }
         if (inout == OUT) {
+#ifndef DCCI_CS
+            return outgoing->size() + clients->size();
+#else
             return outgoing->size();
+#endif
         }
         ERR(F("Unknown queue in size; specifiy either IN or OUT"));
         return 0;
     }
     auto decode(csProtocol p) -> const char *;
     auto decode(comStation s) -> const char *;
+    static bool isBroadcast(const char *msg);   // reply reporting a state change of the layout other clients shall see as well
+    static byte lane(DccMessage &m);            // lane of the queues the message goes into
+    static const char *text(DccMessage &m, char *buffer, int size);    // the payload as text; decodes the binary form into buffer
+    bool isFull(uint16_t c);                          // true if a message of client c can't be queued
+    bool setWeight(uint16_t c, uint8_t w);            // messages of client c taken per round robin round; 1 by default
+    void setBinary(bool b) {
+        binary = b;
+    }
+    void setOpHandler(_tDccOpHandler h) {
+        opHandler = h;
+    }
+    void setHandler(csProtocol p, _tcsProtocolHandler h) {     // replaces the handler of the protocol p
+        handlers[p] = h;
+    }
+    void setBlocking(bool b) {
+        blocking = b;
+    }
+    bool isBlocking() {
+        return blocking;
+    }
+    void setPipeline(byte n) {
+        pipeline = constrain(n, 1, DCCI_CORRELATIONS);
+    }
+    void setWindow(byte w) {
+        window = constrain(w, 1, DCCI_WINDOW);
+    }
+    bool inOrder(DccMessage &m);                      // checks the mid of a message recieved; false if it has to be dropped
+    static bool isUrgent(const char *cmd);            // emergency stop <!> or power off <0 ...>
+    void urgent(uint16_t c, csProtocol p, char *msg, uint32_t rxMicros);   // writes msg to the serial link right away
+    void onUrgent(DccMessage &m);                     // executes an urgent message recieved and acknowledges it
+    void urgentAcked(uint16_t id);
+    void printStats();                                // logs the link counters
+    void acked(uint16_t ack);                         // releases the messages acknowledged by the other station
+    void onReset(uint16_t e);                         // the other station has (re)started with epoch e
+    void onResetAck(uint16_t e);
+    bool isSynced() {
+        return synced;
+    }
+    void post(byte kind, DccMessage &m);              // hands a decoded message to the loop
 
     DccExInterface(); 
     ~DccExInterface();
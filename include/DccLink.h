@@ -0,0 +1,169 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef DccLink_h
+#define DccLink_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+#include "Queue.h"
+
+/**
+ * @brief "Hardware" elated protocols to comuunicate with a connected MCU. 
+ */
+typedef enum
+{
+    _SRL,        // serial
+    _I2C,        // i2c
+    _SPI,        // spi
+    _LOOPBACK,   // in memory; both stations in the same process
+    _UNKNOWN_COM_PROTOCOL
+} comProtocol;
+
+/**
+ * @brief The link between the NetworkStation and the CommandStation as seen by the DccExInterface: a byte
+ * stream the MsgPacketizer frames are written to and read from. Each comProtocol implements it; the
+ * DccExInterface doesn't know which one it is talking over.
+ */
+class DccLink : public Stream
+{
+public:
+    virtual comProtocol protocol() = 0;
+    virtual bool begin(uint32_t speed) = 0;                     // speed is the baud rate or bus clock; ignored if the other side clocks
+    virtual void poll() {}                                      // moves data between the driver and the stream; called each loop
+    virtual bool onReceive(void (*callback)()) {                // calls back from the driver task when data arrives; false if not supported
+        return false;
+    }
+    virtual bool setSpeed(uint32_t speed) {                     // changes the speed of a running link; false if it has none to set
+        return false;
+    }
+    virtual size_t read(uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (n < size && available() > 0)
+        {
+            buffer[n++] = read();
+        }
+        return n;
+    }
+    using Stream::read;
+    using Print::write;
+
+protected:
+    static bool onWirePins(const int *pins, byte n);            // logs and returns true if one of them is SDA or SCL of Wire
+};
+
+/**
+ * @brief UART; the link used so far
+ */
+class UartLink : public DccLink
+{
+private:
+    HardwareSerial *s;
+
+public:
+    UartLink(HardwareSerial *serial) : s(serial) {}
+
+    comProtocol protocol() override {
+        return _SRL;
+    }
+    bool begin(uint32_t speed) override;
+    bool onReceive(void (*callback)()) override;
+    bool setSpeed(uint32_t speed) override;
+    size_t read(uint8_t *buffer, size_t size) override;
+    int available() override {
+        return s->available();
+    }
+    int read() override {
+        return s->read();
+    }
+    int peek() override {
+        return s->peek();
+    }
+    size_t write(uint8_t b) override {
+        return s->write(b);
+    }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        return s->write(buffer, size);
+    }
+    void flush() override {
+        s->flush();
+    }
+};
+
+typedef SpscQueue<uint8_t, DCCI_LINK_RING> _tLinkRing;
+
+/**
+ * @brief Links which move fixed size frames: bytes written are kept in tx until the driver takes them, bytes 
+ * recieved in rx until the DccExInterface reads them. A frame is [length, payload ...]. tx and rx are single 
+ * producer single consumer so the driver task and the loop don't need to lock
+ */
+class FramedLink : public DccLink
+{
+protected:
+    _tLinkRing tx;
+    _tLinkRing rx;
+    int        fill(uint8_t *frame, int size);                  // takes a frame from tx; returns its length with the header
+    void       take(const uint8_t *frame, int size);            // puts the payload of a frame into rx
+
+public:
+    uint32_t   overruns = 0;                                    // bytes lost as rx or tx was full
+
+    using DccLink::read;
+
+    int available() override {
+        return rx.size();
+    }
+    int read() override {
+        uint8_t b;
+        return rx.pop(b) ? b : -1;
+    }
+    int peek() override {
+        uint8_t b;
+        return rx.peek(b) ? b : -1;
+    }
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    void flush() override {}
+};
+
+/**
+ * @brief In memory link between two DccExInterfaces in the same process (e.g. a test on a host where both
+ * stations run); what is written to one end is read from the other
+ */
+class LoopbackLink : public FramedLink
+{
+private:
+    LoopbackLink *peer = nullptr;
+
+public:
+    void connect(LoopbackLink *other) {
+        peer = other;
+        other->peer = this;
+    }
+    comProtocol protocol() override {
+        return _LOOPBACK;
+    }
+    bool begin(uint32_t speed) override {
+        return peer != nullptr;
+    }
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+#endif
@@ -33,6 +33,7 @@ private:
 public:
 
     byte setup();      // sets the TCP server or UDP udp object; returns 1 if the connection was successfull 0 otherwise
+    EthernetServer *startServer(uint16_t port);    // starts an additional TCP server once the setup has been done
     EthernetServer *getTCPServer() {
         return server;
     }
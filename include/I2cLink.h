@@ -0,0 +1,56 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef I2cLink_h
+#define I2cLink_h
+
+#include <Arduino.h>
+#include "DccLink.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <Wire.h>
+
+/**
+ * @brief I2C link with the NetworkStation as slave at DCCI_I2C_ADDRESS and the CommandStation as master. The
+ * master writes its bytes to us and reads frames of DCCI_I2C_FRAME bytes [length, payload ...] from us; it
+ * polls as I2C has no way for the slave to start a transfer. The callbacks run in the I2C slave task of the
+ * Wire library. It takes the second I2C controller by default; Wire is the master of the AR1021 touch controller.
+ */
+class I2cLink : public FramedLink
+{
+private:
+    TwoWire        *wire;
+    static I2cLink *active;                     // the Wire callbacks are plain functions
+
+    static void onWrite(int n);                 // the master has written n bytes
+    static void onRead();                       // the master wants a frame
+
+public:
+    uint32_t        frames = 0;                 // frames read by the master
+
+    I2cLink(TwoWire *w = &Wire1) : wire(w) {}
+
+    comProtocol protocol() override {
+        return _I2C;
+    }
+    bool begin(uint32_t speed) override;
+};
+
+#endif
+#endif
@@ -0,0 +1,62 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef LinkBenchmark_h
+#define LinkBenchmark_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+
+/**
+ * @brief Phases of a benchmark run
+ */
+typedef enum
+{
+    _BENCH_IDLE,
+    _BENCH_SYNC,        // synchronous mode
+    _BENCH_PIPELINED    // pipelined mode
+} benchPhase;
+
+/**
+ * @brief Compares the command throughput of the synchronous and the pipelined link mode. The same number
+ * of <#> commands (cheap on the CS and answered with a single reply) is send in each mode with the client
+ * handle 0; a mode is done once all of them are answered or timed out. The results are logged and the
+ * mode set before the run is restored. Normal traffic continues during the run and is counted as well.
+ */
+class LinkBenchmark
+{
+private:
+    static benchPhase phase;
+    static uint16_t   n;                    // commands per mode
+    static uint16_t   sent;
+    static uint32_t   start;                // micros() the mode has started
+    static uint32_t   elapsed[2];           // us per mode
+    static bool       blocking;             // mode before the run
+
+    static void begin(benchPhase p);
+
+public:
+    static void run(uint16_t commands = 100);
+    static void loop();
+    static bool isRunning() {
+        return phase != _BENCH_IDLE;
+    }
+};
+
+#endif
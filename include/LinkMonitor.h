@@ -0,0 +1,51 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef LinkMonitor_h
+#define LinkMonitor_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include "NetworkInterface.h"
+
+/**
+ * @brief Keeps track of the link state of the Ethernet and WiFi interfaces. The state is set from the
+ * network event task and read by the transports in their loop; a transport drops its clients when 
+ * its link goes down and restarts its servers on the new address once the link is up again. Clients
+ * of a lost link reconnect over the other one; the layout state (e.g. loco ownership) is kept on the 
+ * CommandStation and doesn't depend on the connection it is accessed through.
+ */
+class LinkMonitor
+{
+private:
+    static volatile bool up[2];                     // indexed by transportType
+    static bool registered;
+
+    static void onEvent(WiFiEvent_t event);
+
+public:
+    static void setup();                            // registers the event handler; can be called by every transport setup
+    static bool isUp(transportType t) {
+        return up[t];
+    }
+    static IPAddress localIP(transportType t);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef LinkNegotiator_h
+#define LinkNegotiator_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+
+#include "DccLink.h"
+
+/**
+ * @brief Messages of the negotiation (first parameter of a nego_index frame)
+ */
+typedef enum
+{
+    _NEGO_PROPOSE,      // a: speed; send at the current speed
+    _NEGO_ACCEPT,       // a: speed; both switch to it
+    _NEGO_REPORT_REQ,   // a: test frames send
+    _NEGO_REPORT,       // a: test frames recieved with a valid CRC, b: with an invalid one
+    _NEGO_DONE          // a: speed to stay at
+} negoOp;
+
+typedef enum
+{
+    _NEGO_IDLE,
+    _NEGO_PROPOSING,    // waiting for the accept
+    _NEGO_SETTLING,     // switched; the other side may still be switching
+    _NEGO_TESTING,      // burst send; waiting for the report
+    _NEGO_REVERTING,    // failed; waiting for the other side to fall back by its timeout
+    _NEGO_TRIAL         // follower: at a speed not confirmed yet
+} negoState;
+
+/**
+ * @brief Steps the speed of the link up through DCCI_SPEEDS at startup. The NetworkStation proposes the next
+ * speed, both switch to it and a burst of DCCI_TEST_FRAMES test frames with a CRC16 over their content is send;
+ * the CommandStation reports how many arrived intact. A clean step confirms the speed and the next one is tried;
+ * on errors or silence both fall back to the last confirmed speed, the CommandStation by its own timeout.
+ * Messages per second and the error rate of each step are logged. A CommandStation which doesn't know the
+ * negotiation never accepts and the link stays at the speed it has been set up with.
+ *
+ * The negotiation starts once the other station has been heard. Without a valid frame for DCCI_LINK_SILENCE ms
+ * (the stations send keepalives every DCCI_KEEPALIVE ms) or after DCCI_RTO_FAILS retransmits in a row (see lost())
+ * both stations fall back to the base speed they have been set up with on their own; the NetworkStation 
+ * negotiates again as soon as it hears the other station there, e.g. after the CommandStation has restarted.
+ */
+class LinkNegotiator
+{
+private:
+    static DccLink   *link;
+    static bool      initiator;
+    static negoState state;
+    static byte      step;                      // index of the speed tried in DCCI_SPEEDS
+    static uint32_t  since;                     // millis() of the last state change or negotiation frame
+    static uint32_t  confirmed;                 // speed both sides can fall back to
+    static uint32_t  base;                      // speed set up with; both stations start at it
+    static bool      alive;                     // the other station has been heard within DCCI_LINK_SILENCE
+    static bool      negotiable;                // initiator with a link which can change its speed
+    static bool      negotiate;                 // negotiable and not negotiated at the base speed yet
+    static uint32_t  heardAt;                   // millis() of the last valid frame
+    static uint32_t  trial;
+    static uint32_t  burstStart;                // micros() the burst has started
+    static uint16_t  good, bad;                 // test frames recieved
+
+    static void start();
+    static void propose();
+    static void burst();
+    static void finish();
+    static void send(int op, int32_t a, int32_t b = 0);
+
+public:
+    static uint32_t  speed;                     // current speed
+    static uint32_t  rate;                      // messages per second at the speed settled on
+    static uint16_t  errors;                    // test frames lost or corrupted in all steps
+
+    static void setup(DccLink *l, uint32_t speed, bool initiator);
+    static void loop();
+    static bool isActive() {                    // regular traffic waits while true
+        return state != _NEGO_IDLE;
+    }
+    static void heard();                        // a valid frame has been recieved
+    static void lost();                         // the link is broken; back to the base speed
+    static void onNego(int op, int32_t a, int32_t b);
+    static void onTest(int32_t seq, int32_t w0, int32_t w1, int32_t crc);
+    static uint16_t crc16(int32_t seq, int32_t w0, int32_t w1);
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef MqttSession_h
+#define MqttSession_h
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+#include "NetworkConfig.h"
+
+/**
+ * @brief called for the commands published by a remote client. slot is the slot the client id of the topic
+ * has been mapped to; isNew is set if the slot has been (re)assigned to that client id
+ */
+using MqttReceiver = void (*)(void *owner, uint8_t slot, bool isNew, uint8_t *payload, unsigned int len);
+
+/**
+ * @brief Replies published to one topic which are waiting to be send together in one QoS0 publish
+ */
+struct MqttBatch
+{
+    char     buffer[MQTT_BATCH_SIZE];       // replies separated by a newline
+    uint16_t len = 0;
+    uint32_t since = 0;                     // millis() of the first reply in the batch
+};
+
+/**
+ * @brief Session with the MQTT broker for a Transport running the MQTT protocol. Remote clients publish commands
+ * to MQTT_ROOT/cmd/<client id>; each client id gets one of the slots of the transport so that replies coming back
+ * from the CommandStation with the client handle are published to MQTT_ROOT/reply/<client id>. Broadcasts go to
+ * MQTT_ROOT/broadcast.
+ * The session with the broker is persistent (no clean session and QoS1 subscription) so that commands published
+ * while the NetworkStation is reconnecting are delivered once it is back. Replies are QoS0 and batched per topic
+ * for up to MQTT_BATCH_DELAY ms.
+ */
+class MqttSession
+{
+private:
+    WiFiClient      net;                                // used for Ethernet as well; the ESP32 stack routes by address
+    PubSubClient    mqtt;
+    uint16_t        port;                               // port of the broker
+    uint8_t         slots;                              // number of slots remote clients are mapped to
+    char            ids[MAX_SOCK_NUM][MQTT_ID_LENGTH];  // client id of the slot; empty if the slot is free
+    uint32_t        seen[MAX_SOCK_NUM];                 // millis() of the last command of the client of the slot
+    MqttBatch       batches[MAX_SOCK_NUM + 1];          // one per slot plus one for the broadcasts
+    uint32_t        lastAttempt = 0;                    // millis() of the last connection attempt to the broker
+    void            *owner = nullptr;
+    MqttReceiver    receiver = nullptr;
+
+    void connect();
+    void received(char *topic, uint8_t *payload, unsigned int len);
+    int  slotOf(const char *id, bool &isNew);           // slot for the client id; assigns a free or the least recently used slot
+    bool queue(uint8_t b, const char *msg);
+    void flush(uint8_t b);
+
+public:
+    uint32_t        publishes = 0;                      // publish packets send
+    uint32_t        batched = 0;                        // replies send in these packets
+    uint32_t        dropped = 0;                        // batches dropped as the broker wasn't connected
+
+    void setup(uint16_t port, uint8_t slots, void *owner, MqttReceiver receiver);
+    void loop();                                        // keeps the session with the broker alive and publishes the batches which are due
+    bool publish(uint8_t slot, const char *msg);        // queues a reply for the client of the slot
+    bool broadcast(const char *msg);                    // queues a message for all clients
+    bool isConnected() {
+        return mqtt.connected();
+    }
+};
+
+#endif
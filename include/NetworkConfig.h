@@ -37,6 +37,11 @@
  * 
  */
 #define LISTEN_PORT     2560                                    // default listen port for the server
+#define WITHROTTLE_PORT 12090                                   // default port of WiThrottle servers
+#define HTTP_PORT       80
+#define MQTT_PORT       1883                                    // default port of the MQTT broker
+#define MCAST_GROUP     239, 255, 60, 1                         // multicast group layout state updates are send to; administratively scoped range
+#define MCAST_PORT      2561
 #define MAC_ADDRESS     {0x52, 0xB8, 0x8A, 0x8E, 0xCE, 0x21}    // MAC address of your networking card found on the sticker on your card or take one from above
                                                                 // on ESP32 this will be ignored as all ESP32 with Wifi have their own MAC
 #define IP_ADDRESS      10, 0, 0, 101                           // Just in case we don't get an adress from DHCP try a static one; 10.x.y.z as 192.168.x.y are 
@@ -47,6 +52,7 @@
  * 
  */
 #define MAX_INTERFACES  4                                       // Consume too much memory beyond in general not more than 2 should be required
+#define MAX_LISTENERS   3                                       // Maximum number of ports a single transport listens on
 #define MAX_SOCK_NUM    8                                       // Maximum number of sockets allowed for any WizNet based EthernetShield. The W5100 only supports 4
 #define MAX_WIFI_SOCK   4       
                                 // ESP32 WiFi library states 4 
@@ -56,6 +62,37 @@
     #define MAX_ETH_BUFFER  128  // maximum length we read in one go from a TCP packet. 128 is for Arduinpo devices
 #endif 
                
+#define WIFI_CONNECT_TIMEOUT 10000                              // ms the WiFi setup waits for the connection to the access point
+#define KEEPALIVE_IDLE      5                                   // seconds without traffic before the first TCP keepalive probe is send
+#define KEEPALIVE_INTERVAL  2                                   // seconds between TCP keepalive probes
+#define KEEPALIVE_COUNT     3                                   // unanswered probes after which the connection is dropped by the stack
+#define IDLE_TIMEOUT        0                                   // ms without data from a client before it is disconnected; 0 for no timeout
+#define EVICT_MIN_IDLE      10000                               // ms a client must have been idle to be evicted for a new client if the pool is full
+#define READ_QUANTUM    64                                      // bytes added to the deficit of a connection with data in each round robin round
+#define READ_BUDGET     MAX_ETH_BUFFER                          // bytes read from all connections of a transport per loop
+#define THROUGHPUT_QUANTUM  (MAX_ETH_BUFFER - 1)                // read quantum of the THROUGHPUT profile
+#define THROUGHPUT_BUDGET   (4 * MAX_ETH_BUFFER)                // read budget of the THROUGHPUT profile
+#define THROUGHPUT_TX_BUFFER 256                                // THROUGHPUT profile: replies to a client are collected up to this size
+#define THROUGHPUT_TX_DELAY 5                                   // ms a collected reply may wait for others before it is written
+#define STATS_INTERVAL      60000                               // ms between two logs of the counters of the NetworkStation; 0 never
+#define MQTT_ROOT       "dccex"                                 // topics are MQTT_ROOT/cmd/<client id>, MQTT_ROOT/reply/<client id> and MQTT_ROOT/broadcast
+#define MQTT_CLIENT_ID  "dccex-ns"                              // fixed so that the broker keeps the session of the NetworkStation
+#define MQTT_ID_LENGTH  24                                      // maximum length of the client id of a remote client + 1
+#define MQTT_PACKET_SIZE    512                                 // MQTT packet buffer; limits the size of a batch of commands published by a client
+#define MQTT_BATCH_SIZE     256                                 // replies to the same topic batched in one publish
+#define MQTT_BATCH_DELAY    10                                  // ms a reply may wait for others to the same topic
+#define MQTT_KEEPALIVE      15                                  // seconds
+#define MQTT_SOCKET_TIMEOUT 1                                   // seconds a connection attempt to the broker may block the loop
+#define MQTT_RECONNECT      2000                                // ms between connection attempts to the broker
+#define THROTTLE_SLOTS      16                                  // (loco, client) pairs whose speed commands are coalesced at the same time
+#define THROTTLE_INTERVAL   50                                  // ms between two speed commands for the same loco and client; 0 disables the coalescing
+#define MIRROR_LOCOS        32                                  // locos, turnouts, outputs and sensors the state mirror keeps
+#define MIRROR_TURNOUTS     64
+#define MIRROR_OUTPUTS      32
+#define MIRROR_SENSORS      64
+#define MIRROR_TRACKS       8                                   // power states <p1 MAIN>, <p0 PROG>, ... kept per track
+#define MIRROR_TEXT         48                                  // longest reply kept by the state mirror
+#define MIRROR_SYNC_QUIET   500                                 // ms without a reply to the sync queries after which the mirror is complete
 #define MAX_OVERFLOW    MAX_ETH_BUFFER / 2                      // length of the overflow buffer to be used for a given connection.
 #define MAX_JMRI_CMD    MAX_ETH_BUFFER / 2                      // MAX Length of a JMRI Command
 #define OUTBOUND_RING_SIZE 2048
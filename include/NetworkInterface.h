@@ -21,8 +21,11 @@
 #define NetworkInterface_h
 
 #include <Arduino.h>
+#include <WiFi.h>
 
 #include "NetworkConfig.h"
+#include "ClientHandle.h"
+#include "CommandTokenizer.h"
 #include "HttpRequest.h"
 
 typedef enum protocolType {
@@ -31,6 +34,15 @@ typedef enum protocolType {
     MQTT                      
 } protocolType;
 
+/**
+ * @brief Tuning of a transport for either the lowest latency per command (throttles) or for
+ * the least number of packets and loops (bulk transfers)
+ */
+typedef enum transportProfile {
+    LATENCY,                // TCP_NODELAY, WiFi modem sleep off, small read quantum 
+    THROUGHPUT              // Nagle, WiFi modem sleep on, large read quantum and budget, replies coalesced per client
+} transportProfile;
+
 typedef enum transportType {
     WIFI,                   // using an WIFI cabable board ( ESP AT or not AT based (AT needs to be Version >= V1.7) command enabled ESP8266;
                             // not to be used in conjunction with the WifiInterface though! not tested for conflicts
@@ -40,42 +52,148 @@ typedef enum transportType {
 using HttpCallback = void(*)(ParsedRequest *req, Client *client);
 
 /**
- * @brief Abstract parent class of the templated ( Ethernet or Wifi ) class 
- * Instances of Transports are hold through this in an array in DCCNetwork which describes and 
- * actually manages the available transports.
+ * @brief A port a transport listens on. Connections accepted on a port with a protocol other 
+ * than UNDEFINED are handed to the tokenizer with that protocol and skip the protocol detection
+ */
+struct Listener {
+    uint16_t port;
+    scanType protocol;                  // UNDEFINED: the protocol is detected by the tokenizer
+};
+
+// on the ESP32 there is no disticinction of both
+
+typedef WiFiServer EthernetServer;
+typedef WiFiUDP EthernetUDP;
+typedef WiFiClient EthernetClient;
+
+// the transport type is part of the Transport template so that Ethernet and WiFi
+// are different types even if they share the same server, client and udp classes
+template <class S, class C, class U, transportType N> class Transport;
+
+typedef Transport<EthernetServer, EthernetClient, EthernetUDP, ETHERNET> EthernetTransport;
+typedef Transport<WiFiServer, WiFiClient, WiFiUDP, WIFI> WiFiTransport;
+
+/**
+ * @brief Holds the instances of one Transport type added to the DCCNetwork
+ * 
+ * @tparam T Transport type
  */
-struct AbstractTransport {
-    void loop(){};
-    virtual ~AbstractTransport(){};
+template <class T>
+struct TransportSlots {
+    T    *transports[MAX_INTERFACES];
+    byte count = 0;
 };
 
 /**
  * @brief Core class holding and running the instantiated Transports 
- * initalized through the NetworkInterface. The number of transports is 
+ * initalized through the NetworkInterface. The list of Transport types is 
+ * known at compile time so that the loop calls each Transport directly without
+ * any cast or switch on the transport type. The overall number of transports is 
  * limited by MAX_INTERFACES
  * 
+ * @tparam Ts list of Transport types the network can run
  */
-class DCCNetwork {
+template <class... Ts>
+class DCCNetwork : private TransportSlots<Ts>... {
     private:
         byte _tCounter = 0;                                 // number of initalized transports
-        transportType _t[MAX_INTERFACES];
-        // AbstractTransport *transports[MAX_INTERFACES];
+        uint32_t _bSeq = 0;                                 // sequence number of the last broadcast
+
+        using WriteCallback = bool (*)(void *t, uint16_t handle, const char *msg);
+        void            *_tById[MAX_INTERFACES];            // transports indexed by their id - 1 for the client handle lookup
+        WriteCallback   _wById[MAX_INTERFACES];             // typed write of the transport with the same index
+
+        template <class T> static bool writeTo(void *t, uint16_t handle, const char *msg) {
+            return static_cast<T *>(t)->write(handle, msg);
+        }
+        template <class T> TransportSlots<T> &slots() {
+            return *this;
+        }
+        template <class T> void loopAll() {
+            TransportSlots<T> &s = slots<T>();
+            for (byte i = 0; i < s.count; i++) {
+                s.transports[i]->loop();
+            }
+        }
+        template <class T> void broadcastAll(uint32_t seq, const char *msg) {
+            TransportSlots<T> &s = slots<T>();
+            for (byte i = 0; i < s.count; i++) {
+                s.transports[i]->broadcast(seq, msg);
+            }
+        }
+        template <class T, class F> void visitAll(F &f) {
+            TransportSlots<T> &s = slots<T>();
+            for (byte i = 0; i < s.count; i++) {
+                f(s.transports[i]);
+            }
+        }
 
     public: 
-        AbstractTransport *transports[MAX_INTERFACES];
-        byte add(AbstractTransport* t, transportType _t);   // add a transport to the network
+        /**
+         * @brief add a transport to the network
+         * 
+         * @return byte the index + 1 if added; 0 if MAX_INTERFACES has been reached
+         */
+        template <class T> byte add(T *t) {
+            if (_tCounter == MAX_INTERFACES) {
+                return 0;
+            }
+            TransportSlots<T> &s = slots<T>();
+            s.transports[s.count++] = t;
+            _tById[_tCounter] = t;
+            _wById[_tCounter] = &writeTo<T>;
+            return ++_tCounter;                             // normally a delete shall not be necessary as all is setup at the beginning and shall not change over a session
+        }
         byte getNumberOfTransports() {
             return _tCounter;
         }
-        transportType *getArrayOfTransportTypes() {
-            return _t;
+        template <class T> byte getNumberOfTransports() {
+            return slots<T>().count;
+        }
+        template <class T> T *getTransport(byte i) {
+            return slots<T>().transports[i];
         }
-        AbstractTransport *getArrayOfTransports() {
-            return *transports;
+        /**
+         * @brief writes msg to the connection identified by the client handle without
+         * searching through the transports
+         * 
+         * @return false if the transport is unknown or the handle is stale
+         */
+        bool write(uint16_t handle, const char *msg) {
+            byte id = ClientHandle::transport(handle);
+            if (id == 0 || id > _tCounter) {
+                return false;
+            }
+            return _wById[id - 1](_tById[id - 1], handle, msg);
+        }
+        /**
+         * @brief hands msg to all transports; those with broadcasts send it to all their clients. All
+         * transports send the same event with the same sequence number
+         */
+        void broadcast(const char *msg) {
+            _bSeq++;
+            int expand[] = {0, (broadcastAll<Ts>(_bSeq, msg), 0)...};
+            (void) expand;
+        }
+        /**
+         * @brief calls f(T*) for all transports of all types in the network
+         */
+        template <class F> void visit(F &f) {
+            int expand[] = {0, (visitAll<Ts>(f), 0)...};
+            (void) expand;
+        }
+        void loop() {
+            int expand[] = {0, (loopAll<Ts>(), 0)...};
+            (void) expand;
         }
-        void loop();
 };
 
+/**
+ * @brief The Transport types available on the NetworkStation. Adding a new Transport type 
+ * to the network is done by adding it to this list.
+ */
+typedef DCCNetwork<EthernetTransport, WiFiTransport> DCCNet;
+
 /**
  * @brief Main entry point and provider of callbacks. Sole responsibility is to create
  * the transport endpoints and loop over them for processing
@@ -86,24 +204,30 @@ class NetworkInterface
 private:
     HttpCallback httpCallback;
     transportType t;
-    static DCCNetwork _dccNet;
+    Listener listeners[MAX_LISTENERS];  // ports declared with listen(); all share the connection pool of the transport
+    byte nListeners = 0;
+    IPAddress mcastGroup;
+    uint16_t mcastPort = 0;             // 0 if no multicast of the broadcasts
+    static DCCNet _dccNet;
 
 public:
 
     void setHttpCallback(HttpCallback callback);
     HttpCallback getHttpCallback();
 
-    static DCCNetwork *getDCCNetwork() {
+    static DCCNet *getDCCNetwork() {
         return &_dccNet;
     }
 
-    void setup(transportType t = ETHERNET, protocolType p = TCP, uint16_t port = LISTEN_PORT);                                                     // defaults for all as above plus CABLE (i.e. using EthernetShield ) as default
+    bool listen(uint16_t port, scanType protocol);                                                                                                  // adds a TCP port with a fixed protocol; to be called before setup
+    void multicast(uint16_t port = MCAST_PORT, IPAddress group = IPAddress(MCAST_GROUP));                                                           // sends the broadcasts to a multicast group; to be called before setup
+    void setup(transportType t = ETHERNET, protocolType p = TCP, uint16_t port = LISTEN_PORT, transportProfile tp = LATENCY);                       // defaults for all as above plus CABLE (i.e. using EthernetShield ) as default
+                                                                                                                                                    // port is only used if no port has been declared with listen()
     static void loop(); 
+    static void printStats();                                                                                                                       // logs the counters of all transports
 
     NetworkInterface();
     ~NetworkInterface();
 };
 
-// extern DCCNetwork _dccNet;
-
 #endif
\ No newline at end of file
@@ -26,10 +26,6 @@
 #include "NetworkConfig.h"
 #include "NetworkInterface.h"
 
-typedef WiFiServer EthernetServer;
-typedef WiFiUDP EthernetUDP;
-typedef WiFiClient EthernetClient;
-
 class NetworkSetup
 {
 private:
@@ -41,6 +37,7 @@ public:
     bool            connected;                  // semantics is that the server has successfullt started  or not; client connections will be started in the Transport object
     protocolType    protocol;
     uint16_t        port = LISTEN_PORT;         // Default port
+    transportProfile profile = LATENCY;
 
     NetworkSetup();
     ~NetworkSetup();
@@ -125,4 +125,486 @@ public:
   }
 };
 
-#endif
\ No newline at end of file
+/**
+ * @brief orders the accesses to the elements of an SpscQueue before the one to its index; the compiler must not 
+ * reorder them and on a multi core MCU (ESP32) or a host the other core must see them in that order
+ */
+#if defined(__AVR__)
+#define QUEUE_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define QUEUE_BARRIER() __sync_synchronize()
+#endif
+
+/**
+ * @brief Queue of S - 1 elements shared by exactly one producer and one consumer running in different tasks 
+ * (e.g. a driver task and the loop) without a lock. Only the producer writes tail_ and only the consumer head_;
+ * the element is in place before tail_ moves and has been read before head_ moves. The indices have to be 
+ * read and written in one access, i.e. a 32 bit target or S <= 256 on AVR with the interrupts of the other 
+ * side disabled while an index is updated
+ */
+template <typename T, size_t S>
+class SpscQueue
+{
+private:
+  T queue_[S];
+  volatile size_t head_ = 0;
+  volatile size_t tail_ = 0;
+
+public:
+
+  bool isEmpty() const
+  {
+    return head_ == tail_;
+  }
+
+  bool isFull() const
+  {
+    return (tail_ + 1) % S == head_;
+  }
+
+  /**
+   * @return false if the queue is full; the element hasn't been queued
+   */
+  bool push(const T &element)
+  {
+    size_t tail = tail_;
+    size_t next = (tail + 1) % S;
+    if (next == head_)
+    {
+      return false;
+    }
+    queue_[tail] = element;
+    QUEUE_BARRIER();
+    tail_ = next;
+    return true;
+  }
+
+  /**
+   * @return false if the queue is empty; element is unchanged
+   */
+  bool pop(T &element)
+  {
+    size_t head = head_;
+    if (head == tail_)
+    {
+      return false;
+    }
+    QUEUE_BARRIER();
+    element = queue_[head];
+    QUEUE_BARRIER();
+    head_ = (head + 1) % S;
+    return true;
+  }
+
+  bool peek(T &element) const
+  {
+    size_t head = head_;
+    if (head == tail_)
+    {
+      return false;
+    }
+    QUEUE_BARRIER();
+    element = queue_[head];
+    return true;
+  }
+
+  /**
+   * @brief a snapshot; the other side may have changed it already
+   */
+  size_t size() const
+  {
+    size_t tail = tail_;
+    return (tail + S - head_) % S;
+  }
+};
+
+/**
+ * @brief Queue with L strict priority lanes sharing the storage of S elements. Lane 0 has the highest priority;
+ * pop() and peek() always take the oldest element of the highest lane holding one. Each lane has its own 
+ * capacity so that a full low priority lane can't keep elements of a higher lane out. The capacities are given 
+ * at construction and must not add up to more than S
+ */
+template <typename T, size_t L, size_t S>
+class LaneQueue
+{
+private:
+  T queue_[S];
+  size_t base_[L];    // first slot of the lane
+  size_t cap_[L];
+  size_t head_[L];
+  size_t count_[L];
+
+  int top() const
+  {
+    for (size_t l = 0; l < L; l++)
+    {
+      if (count_[l] > 0)
+      {
+        return l;
+      }
+    }
+    return -1;
+  }
+
+public:
+
+  LaneQueue(const size_t (&capacities)[L])
+  {
+    size_t b = 0;
+    for (size_t l = 0; l < L; l++)
+    {
+      cap_[l] = (b + capacities[l] <= S) ? capacities[l] : S - b;
+      base_[l] = b;
+      head_[l] = 0;
+      count_[l] = 0;
+      b += cap_[l];
+    }
+  }
+
+  bool isEmpty() const
+  {
+    return top() < 0;
+  }
+
+  bool isFull(size_t lane) const
+  {
+    return count_[lane] == cap_[lane];
+  }
+
+  void push(size_t lane, const T &element)
+  {
+    if (isFull(lane))
+    {
+      ERR(F("Lane %d is full. Element hasn't been queued" CR), lane);
+      return;
+    }
+    queue_[base_[lane] + (head_[lane] + count_[lane]) % cap_[lane]] = element;
+    count_[lane]++;
+  }
+
+  T pop()
+  {
+    int l = top();
+    if (l < 0)
+    {
+      WARN(F("Queue is empty. Returning void element" CR));
+      return T();
+    }
+    T element = queue_[base_[l] + head_[l]];
+    head_[l] = (head_[l] + 1) % cap_[l];
+    count_[l]--;
+    return element;
+  }
+
+  T peek()
+  {
+    int l = top();
+    if (l < 0)
+    {
+      WARN(F("Queue is empty. Returning void element" CR));
+      return T();
+    }
+    return queue_[base_[l] + head_[l]];
+  }
+
+  void clear()
+  {
+    for (size_t l = 0; l < L; l++)
+    {
+      head_[l] = 0;
+      count_[l] = 0;
+    }
+  }
+
+  /**
+   * @brief empties one lane
+   *
+   * @return the number of elements dropped
+   */
+  size_t clear(size_t lane)
+  {
+    size_t n = count_[lane];
+    head_[lane] = 0;
+    count_[lane] = 0;
+    return n;
+  }
+
+  /**
+   * @brief returns the number of elements in all lanes
+   */
+  size_t size() const
+  {
+    size_t n = 0;
+    for (size_t l = 0; l < L; l++)
+    {
+      n += count_[l];
+    }
+    return n;
+  }
+
+  size_t size(size_t lane) const
+  {
+    return count_[lane];
+  }
+
+  size_t capacity(size_t lane) const
+  {
+    return cap_[lane];
+  }
+};
+
+/**
+ * @brief N sub-queues of C elements each, one per key (e.g. a client), drained by weighted round robin. A key
+ * gets a sub-queue on its first push, a never used one if there is any, and keeps it until another key needs
+ * one and the sub-queue is empty. The weights are kept per key (up to N of them) so that a key getting another
+ * sub-queue keeps its weight. Each drain() visits all sub-queues once starting with the next one after the last
+ * visit; a sub-queue hands over up to its weight of elements, so a key filling its sub-queue only waits longer
+ * itself. An element refused by the consumer doesn't hold back the ones behind it, which the consumer may take
+ * (e.g. the elements of another lane)
+ */
+template <typename T, size_t N, size_t C>
+class FairQueue
+{
+private:
+  T queue_[N * C];
+  uint16_t key_[N];
+  bool used_[N];
+  uint8_t weight_[N];                 // of the key of the sub-queue
+  uint16_t wKey_[N];                  // keys with a weight set
+  uint8_t wValue_[N];
+  size_t nWeights_ = 0;
+  size_t head_[N];
+  size_t count_[N];
+  size_t cursor_ = 0;
+
+  int find(uint16_t key) const
+  {
+    for (size_t q = 0; q < N; q++)
+    {
+      if (used_[q] && key_[q] == key)
+      {
+        return q;
+      }
+    }
+    return -1;
+  }
+
+  uint8_t weightOf(uint16_t key) const
+  {
+    for (size_t w = 0; w < nWeights_; w++)
+    {
+      if (wKey_[w] == key)
+      {
+        return wValue_[w];
+      }
+    }
+    return 1;
+  }
+
+  int assign(uint16_t key)
+  {
+    int q = find(key);
+    if (q >= 0)
+    {
+      return q;
+    }
+    for (size_t i = 0; i < N; i++)
+    {
+      if (!used_[i])
+      {
+        q = i;
+        break;
+      }
+      if (q < 0 && count_[i] == 0)
+      {
+        q = i;                        // taken over if all sub-queues have been used
+      }
+    }
+    if (q >= 0)
+    {
+      used_[q] = true;
+      key_[q] = key;
+      weight_[q] = weightOf(key);
+    }
+    return q;
+  }
+
+public:
+
+  FairQueue()
+  {
+    clear();
+  }
+
+  /**
+   * @return false if the sub-queue of key is full or all sub-queues are in use by other keys
+   */
+  bool push(uint16_t key, const T &element)
+  {
+    int q = assign(key);
+    if (q < 0 || count_[q] == C)
+    {
+      return false;
+    }
+    queue_[q * C + (head_[q] + count_[q]) % C] = element;
+    count_[q]++;
+    return true;
+  }
+
+  /**
+   * @brief one round robin round; consume(element) returns false if it can't take the element now, the element 
+   * then stays where it is for the next round and the following ones of the sub-queue are offered. The consumer 
+   * keeps the order it needs by refusing the followers of a refused element as well (e.g. all of a full lane)
+   *
+   * @return the number of elements consumed
+   */
+  template <typename F>
+  size_t drain(F consume)
+  {
+    size_t n = 0;
+    for (size_t visited = 0; visited < N; visited++)
+    {
+      size_t q = cursor_;
+      cursor_ = (cursor_ + 1) % N;
+      uint8_t credit = weight_[q];
+      size_t kept = 0;
+      for (size_t i = 0; i < count_[q]; i++)
+      {
+        T &element = queue_[q * C + (head_[q] + i) % C];
+        if (credit > 0 && consume(element))
+        {
+          credit--;
+          n++;
+          continue;
+        }
+        if (kept < i)
+        {
+          queue_[q * C + (head_[q] + kept) % C] = element;
+        }
+        kept++;
+      }
+      count_[q] = kept;
+    }
+    return n;
+  }
+
+  /**
+   * @brief removes the elements for which match(element) returns true from all sub-queues; the others keep 
+   * their order
+   *
+   * @return the number of elements removed
+   */
+  template <typename F>
+  size_t drop(F match)
+  {
+    size_t n = 0;
+    for (size_t q = 0; q < N; q++)
+    {
+      size_t kept = 0;
+      for (size_t i = 0; i < count_[q]; i++)
+      {
+        T &element = queue_[q * C + (head_[q] + i) % C];
+        if (!match(element))
+        {
+          queue_[q * C + (head_[q] + kept) % C] = element;
+          kept++;
+        }
+      }
+      n += count_[q] - kept;
+      count_[q] = kept;
+    }
+    return n;
+  }
+
+  bool isFull(uint16_t key) const
+  {
+    int q = find(key);
+    if (q >= 0)
+    {
+      return count_[q] == C;
+    }
+    for (size_t i = 0; i < N; i++)
+    {
+      if (!used_[i] || count_[i] == 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @return false if N other keys with a sub-queue in use have a weight already
+   */
+  bool setWeight(uint16_t key, uint8_t weight)
+  {
+    weight = weight > 0 ? weight : 1;
+    size_t w = 0;
+    while (w < nWeights_ && wKey_[w] != key)
+    {
+      w++;
+    }
+    if (w == N)
+    {
+      // the table is full; take the entry of a key which has nothing queued
+      for (w = 0; w < N; w++)
+      {
+        int q = find(wKey_[w]);
+        if (q < 0 || count_[q] == 0)
+        {
+          if (q >= 0)
+          {
+            weight_[q] = 1;
+          }
+          break;
+        }
+      }
+      if (w == N)
+      {
+        return false;
+      }
+    }
+    else if (w == nWeights_)
+    {
+      nWeights_++;
+    }
+    wKey_[w] = key;
+    wValue_[w] = weight;
+    int q = find(key);
+    if (q >= 0)
+    {
+      weight_[q] = weight;
+    }
+    return true;
+  }
+
+  void clear()
+  {
+    for (size_t q = 0; q < N; q++)
+    {
+      used_[q] = false;
+      weight_[q] = 1;
+      head_[q] = 0;
+      count_[q] = 0;
+    }
+    nWeights_ = 0;
+  }
+
+  size_t size() const
+  {
+    size_t n = 0;
+    for (size_t q = 0; q < N; q++)
+    {
+      n += count_[q];
+    }
+    return n;
+  }
+
+  size_t size(uint16_t key) const
+  {
+    int q = find(key);
+    return q < 0 ? 0 : count_[q];
+  }
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef SpiLink_h
+#define SpiLink_h
+
+#include <Arduino.h>
+#include "DccLink.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <driver/spi_slave.h>
+
+/**
+ * @brief SPI link with the NetworkStation as slave on the VSPI bus and the CommandStation as master. The slave
+ * always has a transaction of DCCI_SPI_FRAME bytes queued with the DMA so the master can clock a frame at any
+ * time; each frame carries [length, payload ...] in both directions. The handshake line is high while we have
+ * something to send so that the master only polls when needed. The bus clock is set by the master; a few Mbit/s
+ * compared to 115200 baud on the UART.
+ */
+class SpiLink : public FramedLink
+{
+private:
+    spi_slave_transaction_t trans;
+    uint8_t *txFrame = nullptr;                 // DMA capable
+    uint8_t *rxFrame = nullptr;
+    bool    busy = false;                       // a transaction is queued
+
+    void queue();
+
+public:
+    uint32_t frames = 0;                        // transactions done
+
+    comProtocol protocol() override {
+        return _SPI;
+    }
+    bool begin(uint32_t speed) override;
+    void poll() override;
+};
+
+#endif
+#endif
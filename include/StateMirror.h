@@ -0,0 +1,95 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef StateMirror_h
+#define StateMirror_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+
+#include "NetworkConfig.h"
+
+/**
+ * @brief State of the mirror with respect to the CommandStation
+ */
+typedef enum
+{
+    _MIRROR_STALE,      // nothing known; the queries go to the CommandStation
+    _MIRROR_SYNCING,    // the sync queries have been send; waiting for the replies to settle
+    _MIRROR_SYNCED      // the read-only queries are answered locally
+} mirrorState;
+
+struct MirrorEntry
+{
+    int  id;                            // turnout id or cab
+    char text[MIRROR_TEXT];             // last reply for it as send by the CommandStation
+};
+
+struct MirrorSensor
+{
+    int  id;                            // sensor or output id
+    bool active;
+};
+
+/**
+ * @brief Mirror of the loco, turnout, output, sensor and power state of the CommandStation on the NetworkStation.
+ * It is kept current from all replies and broadcasts passing through DccExInterface::replyHandler and
+ * answers the read-only queries <s>, <T>, <Q> and <t cab> without a round trip over the serial link. <s> is
+ * answered as the CommandStation does: the power of each track, the version and the state of all turnouts,
+ * outputs and sensors.
+ *
+ * On start and whenever the CommandStation has restarted (see resync()) the mirror sends <s>, <T>, <Z> and <Q>
+ * itself with the client handle 0; once the replies have settled for MIRROR_SYNC_QUIET ms it is synced.
+ * Until then, and for a table which has overflown, the queries go to the CommandStation as before.
+ */
+class StateMirror
+{
+private:
+    static mirrorState  state;
+    static uint32_t     since;                                  // millis() of the last sync reply
+    static char         version[MIRROR_TEXT];                   // <iDCC-EX ...>
+    static char         power[MIRROR_TRACKS][MIRROR_TEXT];      // <p0|1> for all tracks or <p0|1 track> per track
+    static MirrorEntry  locos[MIRROR_LOCOS];                    // <l cab reg speed functions>
+    static MirrorEntry  turnouts[MIRROR_TURNOUTS];              // <H id ... state>
+    static MirrorSensor outputs[MIRROR_OUTPUTS];                // <Y id ... state>
+    static MirrorSensor sensors[MIRROR_SENSORS];
+    static byte         nPower, nLocos, nTurnouts, nOutputs, nSensors;
+    static bool         overflow[5];                            // locos, turnouts, sensors, outputs, tracks didn't fit
+
+    static void clear();
+    static MirrorEntry *entryOf(MirrorEntry *table, byte &n, byte max, int id, bool &full);
+    static MirrorSensor *flagOf(MirrorSensor *table, byte &n, byte max, int id, bool &full);
+    static void setPower(const char *reply);
+    static void copy(char *to, const char *reply);
+
+public:
+    static uint32_t     answered;                               // queries answered locally
+    static uint32_t     updates;                                // replies the mirror has been updated from
+
+    static void loop();                                         // sends the sync queries and completes the sync
+    static void resync();                                       // the CommandStation has restarted; everything is stale
+    static void update(uint16_t client, const char *reply);     // called for every reply of the CommandStation
+    static bool answer(uint16_t client, const char *cmd);       // true if cmd has been answered from the mirror
+    static bool isSynced() {
+        return state == _MIRROR_SYNCED;
+    }
+    static void printStats();
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef ThrottleCoalescer_h
+#define ThrottleCoalescer_h
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+
+#include "NetworkConfig.h"
+#include "DccExInterface.h"
+
+/**
+ * @brief The last speed command of a client for one loco which hasn't been send yet
+ */
+struct ThrottleSlot
+{
+    uint16_t client;                    // client handle; 0 if the slot is free
+    int      cab;
+    int      speed;                     // speed and direction last send to the CommandStation
+    int      dir;
+    uint32_t sentAt;                    // millis() of the last speed command send
+    bool     pending;                   // cmd is waiting for THROTTLE_INTERVAL to pass
+    char     cmd[MAX_MESSAGE_SIZE];
+};
+
+/**
+ * @brief Sits between the tokenizer and the outgoing queue of the DccExInterface. Throttle commands
+ * <t [reg] cab speed dir> of slider throttles are reduced to at most one per loco and client every
+ * THROTTLE_INTERVAL ms; the last one wins. Stops (speed 0 or -1) and direction changes are never
+ * delayed and drop a pending speed so that it can't overtake them. Everything else is queued as is.
+ */
+class ThrottleCoalescer
+{
+private:
+    static ThrottleSlot slots[THROTTLE_SLOTS];
+
+    static ThrottleSlot *slotOf(uint16_t client, int cab);  // free or least recently used slot if there is none yet
+    static void send(ThrottleSlot *t);
+
+public:
+    static uint32_t received;               // speed commands recieved
+    static uint32_t coalesced;              // speed commands replaced by a later one and never send
+    static uint32_t stopped;                // pending speed commands dropped by an emergency stop / power off
+
+    static void queue(uint16_t client, csProtocol p, char *cmd);
+    static void loop();                     // sends the pending speed commands which are due
+    static void clear();                    // drops the pending speed commands of all clients
+    static void printStats();
+};
+
+#endif
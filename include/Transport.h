@@ -26,15 +26,10 @@
 
 #include "NetworkConfig.h"
 #include "NetworkInterface.h"
+#include "MqttSession.h"
 // #include "DccExInterface.h"
 
 
-// on the ESP32 there is no disticinction of both
-
-typedef WiFiServer EthernetServer;
-typedef WiFiUDP EthernetUDP;
-typedef WiFiClient EthernetClient;
-
 typedef enum
 {
     _DCCEX,          //< > encoded
@@ -57,6 +52,33 @@ struct Connection
 {
     uint8_t id;                             // initalized when the pool is setup
     WiFiClient *client;                     // WiFiClient is used for all types of connections This was Client in short on the Arduino mega
+    scanType protocol = UNDEFINED;          // protocol of the listener which accepted the client; UNDEFINED if it has to be detected
+    uint8_t gen = 0;                        // generation of the slot; incremented for every new client taking the slot
+    uint16_t handle = 0;                    // client handle send with the messages to the CS; 0 if there is no client in the slot
+    int16_t deficit = 0;                    // bytes the connection may still read in the current round robin round
+    char *rx = nullptr;                     // receive region of MAX_ETH_BUFFER bytes from the pool of the transport
+    uint16_t rxStart = 0;                   // start of the data not yet tokenized i.e. an incomplete command
+    uint16_t rxEnd = 0;                     // end of the data recieved
+    uint32_t lastActive = 0;                // millis() when data has been recieved last from the client
+    uint32_t idleTimeout = 0;               // ms without data after which the client is disconnected; 0 for no timeout
+    char *tx = nullptr;                     // THROUGHPUT profile: replies collected for one write; THROUGHPUT_TX_BUFFER bytes
+    uint16_t txLen = 0;
+    uint32_t txSince = 0;                   // millis() the first reply has been collected
+};
+
+/**
+ * @brief Counters of a transport to compare the transport profiles
+ */
+struct TransportStats
+{
+    uint32_t rxBytes = 0;                   // bytes read from the clients
+    uint32_t rxReads = 0;                   // number of reads returning data
+    uint32_t txBytes = 0;                   // bytes written to the clients
+    uint32_t txWrites = 0;                  // number of writes
+    uint32_t txCoalesced = 0;               // replies written together with the one before them
+    uint32_t loops = 0;                     // number of calls to loop()
+    uint32_t loopMicros = 0;                // time spent in loop()
+    uint32_t maxLoopMicros = 0;             // longest loop()
 };
 
 /**
@@ -66,8 +88,9 @@ struct Connection
  * @tparam S 
  * @tparam C 
  * @tparam U 
+ * @tparam N transport type; makes Ethernet and WiFi distinct types for the DCCNetwork
  */
-template <class S, class C, class U> class Transport: public AbstractTransport
+template <class S, class C, class U, transportType N> class Transport
 {
 
 private:
@@ -75,28 +98,53 @@ private:
     Connection          connections[MAX_SOCK_NUM];      // All the connections build by the connectionPool
     byte                active = 0;                     // number of currently active connections (we may have wifi or eth setup but no client connected)
     bool                connected = false;              // Transport is setup        
+    byte                next = 0;                       // slot the round robin over the connections starts with in the next loop
+    bool                linkUp = false;                 // link state seen in the last loop; the first loop with the link up (re)binds the servers
     TransportProcessor* t;                              // pointer to the object which handles the incomming/outgoing flow
+    char*               rxPool = nullptr;               // receive regions of all connections; allocated with the connection pool
+    char*               txPool = nullptr;               // THROUGHPUT profile over TCP: send regions of all connections
+    MqttSession*        mqtt = nullptr;                 // session with the broker if the transport runs MQTT
+    int                 mcastFd = -1;                   // socket sending to the multicast group; opened on the first broadcast while the link is up
 
     void udpHandler(U* udp);                            // Reads from a Udp socket - todo add incomming queue for processing when the flow is faster than we can process commands
-    void tcpSessionHandler(S* server);                  // tcpSessionHandler -> connections are maintained open until close by the client
-    void connectionPool(S* server);                     // allocates the Sockets at setup time and creates the Connections
+    void tcpSessionHandler();                           // tcpSessionHandler -> connections are maintained open until close by the client
+    void accept(S* server, scanType protocol);          // takes a new client from the server into a free slot of the connection pool
+    int  freeSlot();                                    // free slot of the pool; evicts the least recently active client if there is none
+    void close(byte i, const char *reason);             // stops the client of slot i and frees the slot
+    void linkDown();                                    // drops all clients and stops the servers when the link of the transport is lost
+    void linkRestored();                                // restarts the servers on the address of the interface
+    void connectionPool();                              // allocates the Sockets at setup time and creates the Connections shared by all listeners
+    void rxRegions();                                   // hands out a receive region of the pool to each connection
+    void txRegions();                                   // hands out a send region to each connection; replies are then coalesced
+    void flush(byte i);                                 // writes the replies collected for slot i
     void connectionPool(U* udp);                        // allocates the UDP Sockets at setup time and creates the Connection
+    void connectionPool(MqttSession* session);          // creates the Connections the remote MQTT clients are mapped to
+    static void mqttReceive(void *owner, uint8_t slot, bool isNew, uint8_t *payload, unsigned int len);
    
 public:
 
     uint8_t         id;
-    uint16_t        port;
-    uint8_t         protocol;               // TCP or UDP  
+    Listener        listeners[MAX_LISTENERS];   // ports the transport listens on; for UDP only the first one is used; for MQTT it is the port of the broker
+    byte            nListeners = 0;
+    uint8_t         protocol;               // TCP, UDP or MQTT
     uint8_t         transport;              // WIFI or ETHERNET 
-    S*              server;                 // WiFiServer or EthernetServer 
+    S*              servers[MAX_LISTENERS]; // WiFiServer or EthernetServer per listener
     U*              udp;                    // UDP socket object
     uint8_t         maxConnections;         // number of supported connections depending on the network equipment use
+    uint16_t        quantum = READ_QUANTUM; // bytes a connection with data gets per round robin round
+    uint16_t        budget = READ_BUDGET;   // bytes read from all connections per loop
+    uint32_t        idleTimeout = IDLE_TIMEOUT;     // idle timeout given to new connections
+    uint32_t        evictMinIdle = EVICT_MIN_IDLE;  // ms a client must be idle before it can be evicted for a new one
+
+    transportProfile profile = LATENCY;     // set before setup()
+    IPAddress       mcastGroup;             // group the broadcasts are send to
+    uint16_t        mcastPort = 0;          // 0 if the broadcasts aren't multicast
+    TransportStats  stats;
 
     bool setup(NetworkInterface* nwi);      // we get the callbacks from the NetworkInterface 
     void loop(); 
-    C getClient(int c) {
-        return clients[c];
-    }
+    bool write(uint16_t handle, const char *msg);   // writes msg to the client identified by the handle; false if the handle is stale
+    void broadcast(uint32_t seq, const char *msg);  // publishes msg for all clients (MQTT) and/or sends it to the multicast group
 
     bool isConnected() {
         return connected;
@@ -104,13 +152,11 @@ public:
     byte getActive() {
         return active;
     }
+    void printStats();
 
-    Transport<S,C,U>();
-    ~Transport<S,C,U>();
+    Transport();
+    ~Transport();
     
 };
 
-typedef Transport<EthernetServer,EthernetClient,EthernetUDP>  EthernetTransport;
-typedef Transport<WiFiServer, WiFiClient, WiFiUDP> WiFiTransport;
-
 #endif // !Transport_h
\ No newline at end of file
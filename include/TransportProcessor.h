@@ -32,15 +32,17 @@ class TransportProcessor
 private:
 
     static Connection *currentConnection;
+    static uint32_t rxMicros;               // micros() when the data being tokenized has been recieved
     static void tokenHandler(scanType s, char *token);
 
 public:
     UDP *udp;                                 // need to carry the single UDP server instance over to the processor for sending packest
     NetworkInterface *nwi;
-    uint8_t buffer[MAX_ETH_BUFFER];
-    char command[MAX_JMRI_CMD];
 
-    void readStream(Connection *c, bool read); // process incomming packets and processes them; if read = false the buffer has already been filled 
+    int readStream(Connection *c, int max = MAX_ETH_BUFFER - 1);   // reads at most max bytes into the receive region of the connection and processes them
+                                                                    // returns the number of bytes read
+    int reserve(Connection *c);               // free space in the receive region of the connection; moves an incomplete command to the start if needed 
+    void scan(Connection *c, int n, uint32_t at);   // tokenizes the n bytes just read into the receive region together with an incomplete command before them
 
     TransportProcessor(){};
     ~TransportProcessor(){};
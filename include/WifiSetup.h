@@ -37,12 +37,13 @@ class WifiSetup: public NetworkSetup {
 
 private:
 
-    WiFiServer*         server;
-    WiFiUDP*            udp;
+    WiFiServer*         server = 0;
+    WiFiUDP*            udp = 0;
 
 public:
 
     bool setup();
+    WiFiServer *startServer(uint16_t port);        // starts an additional TCP server once the setup has been done
 
     WiFiUDP* getUDPServer() {
         return udp;
@@ -53,7 +54,7 @@ public:
     }
 
     WifiSetup();
-    WifiSetup(uint16_t port, protocolType protocol);
+    WifiSetup(uint16_t port, protocolType protocol, transportProfile profile = LATENCY);
     ~WifiSetup();
 };
 
@@ -60,7 +60,7 @@
 CommandTokenizer::scanState CommandTokenizer::stateStartScan()
 {
     CommandToken *ct;
-    ct = findScanType(*current);
+    ct = (pinned == UNDEFINED) ? findScanType(*current) : findPinnedScanType(*current);
     if (*current != '\0' && ct != NULL)
     {
         if (ct->getCmdType() != UNDEFINED)
@@ -81,14 +81,13 @@ CommandTokenizer::scanState CommandTokenizer::stateStartScan()
 CommandTokenizer::scanState CommandTokenizer::stateOverflow()
 {
     int clen = (end - start) + 1;
-    if (clen >= MAX_MESSAGE_SIZE / 2)
+    if (clen > MAX_MESSAGE_SIZE)
     {
-        // WARN command too long
-        // send warning and ignore the command
+        WARN(F("Incomplete command too long: ignoring" CR));
+        rest = end;                             // nothing to be kept
+        return (FINAL);
     }
-    memset(overflow, 0, MAX_MESSAGE_SIZE / 2); // clean the buffer
-    strncpy(overflow, start, clen - 1);        // remove the CRLF
-    // std::cout << "Handling overflow copying: " << overflow << std::endl;
+    rest = start;                               // the incomplete command stays where it is in the buffer of the caller
     return (FINAL);
 }
 // we never actual get here ? check this
@@ -121,9 +120,6 @@ CommandTokenizer::scanState CommandTokenizer::stateInToken(char *scanBuffer, con
 }
 CommandTokenizer::scanState CommandTokenizer::stateEndToken(char *scanBuffer, const int len)
 {
-    char buffer[MAX_MESSAGE_SIZE] = {'\0'}; // this is for temp storage of the command to be send to the CS
-    // std::cout << token[currentCmdType]->getName() <<  " end found : ";  // get the right one
-
     int clen = (end - start) + 1;
     if (clen >= MAX_MESSAGE_SIZE)
     {
@@ -131,11 +127,11 @@ CommandTokenizer::scanState CommandTokenizer::stateEndToken(char *scanBuffer, co
         // try to recover and find the next token
         return STARTSCAN;
     }
-    memset(buffer, 0, MAX_MESSAGE_SIZE); // clean the buffer
-    strncpy(buffer, start, clen);
-
-    // INFO(F("Callback for Queuing buffer %d %d %s" CR), (current == &scanBuffer[len]), clen, buffer);
-    callback(currentCmdType, buffer);
+    // hand the token over in place; terminate it for the callback and restore the char after it
+    char next = end[1];
+    end[1] = '\0';
+    callback(currentCmdType, start);
+    end[1] = next;
 
     if (current == &scanBuffer[len])
     {
@@ -148,23 +144,19 @@ CommandTokenizer::scanState CommandTokenizer::stateEndToken(char *scanBuffer, co
         return (STARTSCAN);
     }
 }
-void CommandTokenizer::scanCommands(char *in, const int inl, void (*cb)(scanType s, char *token))
+int CommandTokenizer::scanCommands(char *in, const int len, void (*cb)(scanType s, char *token), scanType protocol)
 {
 
     // all possible token i can find are listed in here
     // this needs to be completed when there are new tokens to be added
 
     callback = cb;
-    int len = inl + strlen(overflow); // overall length we need overflow plus length of the incomming stream
-    char scanBuffer[len];             // allocate the buffer for all of the content
-
-    memset(scanBuffer, 0, len);              // clean the content buffer
-    strcat(scanBuffer, overflow);            // copy the overflow into the buffer
-    strcat(scanBuffer, in);                  // append the incomming buffer
-    memset(overflow, 0, MAX_ETH_BUFFER / 2); // clean the overflow buffer once it has been used
+    pinned = (token[protocol] != NULL) ? protocol : UNDEFINED;  // only pin protocols the tokenizer knows about
+    char *scanBuffer = in;            // scan in place; in[len] has to be accessible and is used as terminator
 
     start = scanBuffer; // set start & end pointers
     current = scanBuffer;
+    rest = &scanBuffer[len];          // everything is consumed unless an incomplete command is found at the end
 
     scanState state = STARTSCAN;
 
@@ -213,9 +205,9 @@ void CommandTokenizer::scanCommands(char *in, const int inl, void (*cb)(scanType
         }
         if (current == &scanBuffer[len])
         {
-            if (state != OVERFLOW)
+            if (state != OVERFLOW && state != IN_TOKEN)
             {
-                state = FINAL; // we have reached the end of the buffer;
+                state = FINAL; // we have reached the end of the buffer; a token started with the last char still needs to be kept
             }
         }
         else
@@ -223,7 +215,7 @@ void CommandTokenizer::scanCommands(char *in, const int inl, void (*cb)(scanType
             current++;
         }
     }
-    return;
+    return rest - scanBuffer;
 }
 
 /*
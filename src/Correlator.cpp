@@ -0,0 +1,214 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "Correlator.h"
+
+static const char *classNames[DCCI_LANES] = {"ctrl", "throttle", "accessory", "prog"};
+
+Correlation      Correlator::table[DCCI_CORRELATIONS];
+LatencyHistogram Correlator::link[DCCI_LANES];
+LatencyHistogram Correlator::reply[DCCI_LANES];
+uint32_t         Correlator::timeouts[DCCI_LANES] = {0};
+uint32_t         Correlator::evicted = 0;
+uint32_t         Correlator::unmatched = 0;
+
+void LatencyHistogram::add(uint32_t us)
+{
+    uint32_t ms = us / 1000;
+    byte b = 0;
+    while (ms > 0 && b < DCCI_LATENCY_BUCKETS - 1)
+    {
+        ms >>= 1;
+        b++;
+    }
+    buckets[b]++;
+    count++;
+    max = us > max ? us : max;
+}
+
+void LatencyHistogram::print(const char *name)
+{
+    char line[12 * DCCI_LATENCY_BUCKETS];
+    int len = 0;
+    for (byte b = 0; b < DCCI_LATENCY_BUCKETS && len < (int) sizeof(line); b++)
+    {
+        len += snprintf(&line[len], sizeof(line) - len, " %d", buckets[b]);
+    }
+    INFO(F("  %s: [%d] max [%d]us <1ms,<2ms,<4ms...:%s" CR), name, count, max, line);
+}
+
+/**
+ * @brief the DCC-EX commands which are only executed (accessories, writes on main, functions, raw packets, 
+ * diagnostics) and the throttle command with a speed, which is answered by a broadcast, have no reply of their 
+ * own; they must neither hold back the next command nor time out. WiThrottle isn't answered by the CS yet
+ * (notYetHandler)
+ */
+bool Correlator::isCommand(DccMessage &m)
+{
+    if (m.p != _DCCEX)
+    {
+        return false;
+    }
+    char op = DccExCodec::opcode(m.msg);
+    if (op == 0 || strchr("aAwbfF-DMPU", op) != nullptr)
+    {
+        return false;
+    }
+    if (op == 't')
+    {
+        DccOp t;
+        bool ok = DccExCodec::isBinary(m.msg) ? DccExCodec::decode(m.msg, m.len, t) : DccExCodec::parse(m.msg, t);
+        return !ok || t.n <= 1;         // <t cab> queries the loco
+    }
+    return true;
+}
+
+void Correlator::sent(DccMessage &m)
+{
+    Correlation *c = &table[0];
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        if (!table[i].used)
+        {
+            c = &table[i];
+            break;
+        }
+        if ((int32_t) (table[i].sentAt - c->sentAt) < 0)
+        {
+            c = &table[i];
+        }
+    }
+    if (c->used)
+    {
+        evicted++;
+    }
+    c->used = true;
+    c->mid = m.mid;
+    c->client = m.client;
+    c->opcode = DccExCodec::opcode(m.msg);
+    c->lane = DccExInterface::lane(m);
+    c->sentAt = micros();
+    c->acked = false;
+}
+
+byte Correlator::pending()
+{
+    byte n = 0;
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        n += table[i].used;
+    }
+    return n;
+}
+
+void Correlator::acked(uint16_t mid)
+{
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        if (table[i].used && table[i].mid == mid && !table[i].acked)
+        {
+            table[i].acked = true;
+            link[table[i].lane].add(micros() - table[i].sentAt);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief the first reply completes the command and goes to the client which sent it, whatever client the 
+ * CommandStation put into the reply; further replies of the same command (e.g. lists) and replies the CS 
+ * sends on its own go to the client of the message
+ */
+uint16_t Correlator::replied(DccMessage &m)
+{
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        Correlation *c = &table[i];
+        if (c->used && c->mid == (uint16_t) m.rid)
+        {
+            if (!c->acked)
+            {
+                acked(c->mid);              // the reply acknowledges the command as well
+            }
+            reply[c->lane].add(micros() - c->sentAt);
+            c->used = false;
+            return c->client;
+        }
+    }
+    unmatched++;
+    return m.client;
+}
+
+void Correlator::loop()
+{
+    uint32_t now = micros();
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        Correlation *c = &table[i];
+        if (c->used && now - c->sentAt >= DCCI_REPLY_TIMEOUT * 1000UL)
+        {
+            WARN(F("No reply for [%d:%c] of client [%x] within %dms" CR), c->mid, c->opcode, c->client, DCCI_REPLY_TIMEOUT);
+            timeouts[c->lane]++;
+            c->used = false;
+        }
+    }
+}
+
+void Correlator::clear()
+{
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        table[i].used = false;
+    }
+}
+
+byte Correlator::cancel(byte lane)
+{
+    byte n = 0;
+    for (byte i = 0; i < DCCI_CORRELATIONS; i++)
+    {
+        if (table[i].used && table[i].lane == lane)
+        {
+            table[i].used = false;
+            n++;
+        }
+    }
+    return n;
+}
+
+void Correlator::printStats()
+{
+    INFO(F("Latency: [%d] unmatched replies [%d] evicted" CR), unmatched, evicted);
+    char name[24];
+    for (byte l = 0; l < DCCI_LANES; l++)
+    {
+        if (link[l].count == 0 && timeouts[l] == 0)
+        {
+            continue;
+        }
+        INFO(F(" %s: [%d] timeouts" CR), classNames[l], timeouts[l]);
+        snprintf(name, sizeof(name), "%s link", classNames[l]);
+        link[l].print(name);
+        snprintf(name, sizeof(name), "%s reply", classNames[l]);
+        reply[l].print(name);
+    }
+}
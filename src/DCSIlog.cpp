@@ -51,7 +51,6 @@ unsigned int FSHlength(const __FlashStringHelper * FSHinput) {
  */
 void DCSILog::diag(const FSH *input...)
 {
-    StringPrint stream;
     DccMessage diagMsg;
     // get the format sting from Progmem
     const byte inputLength = FSHlength(input);
@@ -64,22 +63,19 @@ void DCSILog::diag(const FSH *input...)
     va_start(args, input);
     vsnprintf(buffer, MAX_MESSAGE_SIZE-1, inputBuffer, args);
 
-    stream.print(F("<* "));  
-    stream.print(buffer);
-    // send(&stream,input,args);           // send a stream whatever to get he output from the DIAG
-    stream.print(F(" *>\n"));           // then add postfix print(F(" *>\n"));
+    // format directly into the message; no String on the heap
+    int n = snprintf(diagMsg.msg, MAX_MESSAGE_SIZE, "<* %s *>", buffer);
 
     diagMsg.client = 0; // TODO make sure we get the right client add CTRL messsage to set the client in
                         // TODO DCSIlog object
 
-    if (stream.str().length() > MAX_MESSAGE_SIZE) { 
+    if (n >= MAX_MESSAGE_SIZE) { 
         WARN(F("Warning DIAG message has been truncated before being send"));    // warn that ths string will be truncated (ev ad an ellipse to show this ...)
-        diagMsg.msg = stream.str().substring(0,MAX_MESSAGE_SIZE-1);
-    } else {
-        diagMsg.msg = stream.str().substring(0,stream.str().length()-1);
+        n = MAX_MESSAGE_SIZE - 1;
     }
+    diagMsg.len = n;
 
-    INFO(F("Sending Diagnostics: %s" CR),diagMsg.msg.c_str());
+    INFO(F("Sending Diagnostics: %s" CR),diagMsg.msg);
     DCCI.queue(OUT, _DIAG, diagMsg);     // queue the msg to be send with protocol DIAG
     
     // test for msg size .. if > max message size truncate and send a warning as additional DIAG message  ... 
@@ -94,13 +90,9 @@ void DCSILog::diag(const FSH *input...)
  * @param ec id of the message to be shown on the _NWSTA
  */
 void DCSILog::flow(char t,int ec) {
-    StringPrint stream;
     DccMessage diagMsg;
-    char buffer[MAX_MESSAGE_SIZE];
     
-    sprintf(buffer, "%c%d", t, ec);
-    stream.print(buffer);
-    diagMsg.msg = stream.str();
+    diagMsg.len = snprintf(diagMsg.msg, MAX_MESSAGE_SIZE, "%c%d", t, ec);
     diagMsg.client = 0;
     diagMsg.sta = _DCCSTA;
 
@@ -0,0 +1,191 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIconfig.h>
+#include "DccExCodec.h"
+
+// opcodes with a binary form; the index is the opcode byte. Append only, both stations need the same table
+//                          throttle, function, turnout, power on/off, sensor, status
+//                          loco state, turnout state, sensor active/inactive, power state
+static const char opcodes[] = "tFT10SQslHqp";
+
+static int indexOf(char opcode)
+{
+    for (byte i = 0; opcodes[i] != 0; i++)
+    {
+        if (opcodes[i] == opcode)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+char DccExCodec::opcode(const char *msg)
+{
+    if (isBinary(msg))
+    {
+        uint8_t i = (uint8_t) msg[0] & 0x7F;
+        return i < sizeof(opcodes) - 1 ? opcodes[i] : 0;
+    }
+    return msg[0] == '<' ? msg[1] : 0;
+}
+
+/**
+ * @brief parses a command with numeric parameters only; keywords (e.g. <1 MAIN>) or text
+ * parameters make it fail
+ */
+bool DccExCodec::parse(const char *text, DccOp &op)
+{
+    if (text[0] != '<' || text[1] == 0)
+    {
+        return false;
+    }
+    op.opcode = text[1];
+    op.n = 0;
+    const char *c = &text[2];
+    while (true)
+    {
+        while (*c == ' ')
+        {
+            c++;
+        }
+        if (*c == '>')
+        {
+            return c[1] == 0;
+        }
+        if (op.n == DCCOP_MAX_PARAMS)
+        {
+            return false;
+        }
+        bool neg = (*c == '-');
+        if (neg)
+        {
+            c++;
+        }
+        if (*c < '0' || *c > '9')
+        {
+            return false;
+        }
+        long v = 0;
+        while (*c >= '0' && *c <= '9')
+        {
+            v = v * 10 + (*c++ - '0');
+            if (v > 32767)
+            {
+                return false;               // has to fit an int on the AVR
+            }
+        }
+        op.p[op.n++] = neg ? -v : v;
+    }
+}
+
+int DccExCodec::toText(const DccOp &op, char *out, int size)
+{
+    int len = snprintf(out, size, "<%c", op.opcode);
+    for (byte i = 0; i < op.n && len < size; i++)
+    {
+        len += snprintf(&out[len], size - len, " %d", op.p[i]);
+    }
+    if (len < size)
+    {
+        len += snprintf(&out[len], size - len, ">");
+    }
+    return min(len, size - 1);
+}
+
+/**
+ * @brief encodes text if it is a command of the opcode table with numeric parameters in the canonical form
+ * i.e. a single space before each parameter so that the CommandStation sees exactly what has been send
+ *
+ * @return the length of the binary form written to out (0 terminated) or 0 if text has to be send as is
+ */
+int DccExCodec::encode(const char *text, char *out, int size)
+{
+    DccOp op;
+    if (!parse(text, op))
+    {
+        return 0;
+    }
+    int i = indexOf(op.opcode);
+    if (i < 0)
+    {
+        return 0;
+    }
+    char canonical[MAX_MESSAGE_SIZE];
+    toText(op, canonical, sizeof(canonical));
+    if (strcmp(canonical, text) != 0)
+    {
+        return 0;
+    }
+    int len = 0;
+    out[len++] = (char) (0x80 | i);
+    for (byte k = 0; k < op.n; k++)
+    {
+        // zigzag so that small negative values (e.g. speed -1) stay short
+        uint16_t v = (op.p[k] << 1) ^ (op.p[k] < 0 ? 0xFFFF : 0);
+        do
+        {
+            if (len >= size - 1)
+            {
+                return 0;
+            }
+            uint8_t d = v % 127;
+            v /= 127;
+            out[len++] = (char) (v ? 0x80 + d : d + 1);
+        } while (v);
+    }
+    out[len] = 0;
+    return len;
+}
+
+bool DccExCodec::decode(const char *bin, uint8_t len, DccOp &op)
+{
+    uint8_t i = (uint8_t) bin[0] & 0x7F;
+    if (!isBinary(bin) || i >= sizeof(opcodes) - 1)
+    {
+        return false;
+    }
+    op.opcode = opcodes[i];
+    op.n = 0;
+    uint8_t k = 1;
+    while (k < len)
+    {
+        if (op.n == DCCOP_MAX_PARAMS)
+        {
+            return false;
+        }
+        uint16_t v = 0;
+        uint16_t scale = 1;
+        uint8_t b;
+        while ((b = (uint8_t) bin[k++]) >= 0x80)
+        {
+            v += (b - 0x80) * scale;
+            scale *= 127;
+            if (k >= len)
+            {
+                return false;               // last digit missing
+            }
+        }
+        v += (b - 1) * scale;
+        op.p[op.n++] = (int) ((v >> 1) ^ -(int) (v & 1));
+    }
+    return true;
+}
@@ -37,36 +37,320 @@
 #ifndef DCCI_CS
 #include "NetworkInterface.h"
 #include "Transport.h"
-DCCNetwork *network = NetworkInterface::getDCCNetwork();
+#include "StateMirror.h"
+#include "Correlator.h"
+DCCNet *network = NetworkInterface::getDCCNetwork();
 #endif
 #include "DccExInterface.h"
 #include "DCSICommand.h"
 
 /**
- * @brief callback function upon reception of a DccMessage. Adds the message into the incomming queue
- * Queue elements will be processed then in the recieve() function called form the loop()
+ * @brief the fields of a DccMessage in the msgpack format: positive / negative fixint, uint 8/16/32 and 
+ * int 8/16/32; the payload as fixstr or str 8
+ */
+static size_t intSize(int32_t v)
+{
+    if (v >= -32 && v < 128)
+    {
+        return 1;
+    }
+    if ((v >= 0 && v < 0x100) || (v >= -128 && v < 0))
+    {
+        return 2;
+    }
+    if ((v >= 0 && v < 0x10000) || (v >= -32768 && v < 0))
+    {
+        return 3;
+    }
+    return 5;
+}
+static uint8_t *packInt(uint8_t *b, int32_t v)
+{
+    switch (intSize(v))
+    {
+    case 1:
+        *b++ = (uint8_t) v;
+        return b;
+    case 2:
+        *b++ = v < 0 ? 0xD0 : 0xCC;
+        *b++ = (uint8_t) v;
+        return b;
+    case 3:
+        *b++ = v < 0 ? 0xD1 : 0xCD;
+        break;
+    default:
+        *b++ = v < 0 ? 0xD2 : 0xCE;
+        *b++ = (uint8_t) (v >> 24);
+        *b++ = (uint8_t) (v >> 16);
+        break;
+    }
+    *b++ = (uint8_t) (v >> 8);
+    *b++ = (uint8_t) v;
+    return b;
+}
+static const uint8_t *unpackInt(const uint8_t *b, const uint8_t *end, int &v)
+{
+    if (b >= end)
+    {
+        return nullptr;
+    }
+    uint8_t t = *b++;
+    if (t < 0x80 || t >= 0xE0)
+    {
+        v = (int8_t) t;
+        return b;
+    }
+    byte n;
+    switch (t)
+    {
+    case 0xCC: case 0xD0: n = 1; break;
+    case 0xCD: case 0xD1: n = 2; break;
+    case 0xCE: case 0xD2: n = 4; break;
+    default:
+        return nullptr;
+    }
+    if (end - b < n)
+    {
+        return nullptr;
+    }
+    uint32_t u = 0;
+    for (byte i = 0; i < n; i++)
+    {
+        u = (u << 8) | *b++;
+    }
+    if (t >= 0xD0 && n < 4 && (u & (0x80UL << (8 * (n - 1)))))
+    {
+        u |= 0xFFFFFFFFUL << (8 * n);       // sign extend
+    }
+    v = (int) (int32_t) u;
+    return b;
+}
+size_t DccMessage::packedSize() const
+{
+    return 1 + intSize(sta) + intSize(mid) + intSize(client) + intSize(p) + intSize(ack) + intSize(rid) + (len < 32 ? 1 : 2) + len;
+}
+size_t DccMessage::pack(uint8_t *buffer) const
+{
+    uint8_t *b = buffer;
+    *b++ = 0x97;                            // fixarray of 7
+    b = packInt(b, sta);
+    b = packInt(b, mid);
+    b = packInt(b, client);
+    b = packInt(b, p);
+    b = packInt(b, ack);
+    b = packInt(b, rid);
+    if (len < 32)
+    {
+        *b++ = 0xA0 | len;
+    }
+    else
+    {
+        *b++ = 0xD9;
+        *b++ = len;
+    }
+    memcpy(b, msg, len);
+    return b + len - buffer;
+}
+/**
+ * @brief the payload is copied into msg right from the frame
+ */
+size_t DccMessage::unpack(const uint8_t *data, size_t size)
+{
+    const uint8_t *b = data;
+    const uint8_t *end = data + size;
+    if (size < 1 || *b++ != 0x97)
+    {
+        return 0;
+    }
+    int *fields[] = {&sta, &mid, &client, &p, &ack, &rid};
+    for (byte i = 0; i < 6; i++)
+    {
+        if ((b = unpackInt(b, end, *fields[i])) == nullptr)
+        {
+            return 0;
+        }
+    }
+    if (b >= end)
+    {
+        return 0;
+    }
+    size_t n;
+    if ((*b & 0xE0) == 0xA0)
+    {
+        n = *b++ & 0x1F;
+    }
+    else if (*b == 0xD9 && end - b >= 2)
+    {
+        b++;
+        n = *b++;
+    }
+    else
+    {
+        return 0;
+    }
+    if ((size_t) (end - b) < n)
+    {
+        return 0;
+    }
+    len = n < MAX_MESSAGE_SIZE ? n : MAX_MESSAGE_SIZE - 1;
+    if (len < n)
+    {
+        WARN(F("Message [%d] truncated to %d characters" CR), mid, MAX_MESSAGE_SIZE - 1);
+    }
+    memcpy(msg, b, len);
+    msg[len] = 0;
+    return b + n - data;
+}
+bool DccBatch::add(const DccMessage &m)
+{
+    size_t b = m.packedSize();
+    if (n == DCCI_BATCH_MAX || size + b > sizeof(data))
+    {
+        return false;
+    }
+    size += m.pack(data + size);
+    n++;
+    data[0] = 0x90 | n;                     // fixarray of the messages
+    return true;
+}
+/**
+ * @brief calls f for each message of a frame; a batch frame (batch true) holds the array of the messages
  *
- * @param msg DccMessage object deliverd by MsgPacketizer
+ * @return false if the frame is corrupted; the messages before the corruption have been handed to f
  */
-void foofunc2(DccMessage msg)
+template <typename F>
+static bool unpackFrame(const uint8_t *data, size_t size, bool batch, F f)
 {
-    // TRC(F("Enter fooFunc2" CR));
-    // const int qs = DCCI.getQueue(IN)->size();
-    // const comStation station = static_cast<comStation>(msg.sta); // Dangerous it will always succedd and thus have ev values outside ofthe enum
-    // const comStation station = _DCCSTA; // for testing purposes
-
-    if (!DCCI.getQueue(IN)->isFull())
-    { // test if queue isn't full
-
-        TRC(F("Recieved from [%s]:[%d:%d:%d:%d]: %s" CR), DCCI.decode(static_cast<comStation>(msg.sta)), DCCI.getQueue(IN)->size(), msg.mid, msg.client, msg.p, msg.msg.c_str());
-        DCCI.getQueue(IN)->push(msg); // push the message into the incomming queue
-        // TRC(F(" Memory ->" CR));
+    byte n = 1;
+    if (batch)
+    {
+        if (size < 1 || (data[0] & 0xF0) != 0x90)
+        {
+            return false;
+        }
+        n = data[0] & 0x0F;
+        data++;
+        size--;
+    }
+    DccMessage m;
+    for (byte i = 0; i < n; i++)
+    {
+        size_t used = m.unpack(data, size);
+        if (used == 0)
+        {
+            return false;
+        }
+        f(m);
+        data += used;
+        size -= used;
+    }
+    return true;
+}
+/**
+ * @brief a message recieved; it is added to the incomming queue in the order it has been send and processed 
+ * by recieve() called from the loop()
+ */
+void DccExInterface::received(DccMessage &msg)
+{
+    if (!inOrder(msg))
+    {
+        hold(msg);                      // ahead of expected; it came over a faster link
+        return;                         // duplicate, gap or no space left; it will be send again if needed
+    }
+    byte l = lane(msg);
+    if (!incomming->isFull(l))
+    {
+        TRC(F("Recieved from [%s]:[%d:%d:%d:%d]: %s" CR), decode(static_cast<comStation>(msg.sta)), incomming->size(), msg.mid, msg.client, msg.p, DccExCodec::isBinary(msg.msg) ? "<bin>" : msg.msg);
+        incomming->push(l, msg);
     }
     else
     {
         ERR(F("Incomming queue is full; Message has not been processed" CR));
     }
+    release();
+}
+/**
+ * @brief a frame of one or a batch of DccMessages
+ */
+void DccExInterface::onFrame(const uint8_t *data, size_t size, bool batch)
+{
+    LinkNegotiator::heard();
+    if (batch)
+    {
+        TRC(F("Recieved batch of [%d] messages" CR), size > 0 ? data[0] & 0x0F : 0);
+    }
+    if (!unpackFrame(data, size, batch, [this](DccMessage &m) { received(m); }))
+    {
+        ERR(F("Invalid message frame; Messages dropped" CR));
+    }
+}
+#ifdef DCCI_RX_ASYNC
+DccExInterface *DccExInterface::rxOwner = nullptr;
+/**
+ * @brief called by the UART event task whenever the driver has data i.e. the RX FIFO reached its threshold or
+ * the line went idle. The driver ring (DCCI_RX_RING) is drained into the decoder right away, whatever the loop does
+ */
+void DccExInterface::onRx()
+{
+    uint8_t buffer[64];
+    int n;
+    while ((n = rxOwner->link->available()) > 0)
+    {
+        n = rxOwner->link->read(buffer, min(n, (int) sizeof(buffer)));
+        MsgPacketizer::feed(buffer, n);
+    }
+}
+void DccExInterface::post(byte kind, DccMessage &m)
+{
+    DccRxEvent e;
+    e.kind = kind;
+    e.at = micros();
+    e.m = m;
+    if (xQueueSend(rxEvents, &e, 0) != pdTRUE)
+    {
+        rxOverruns++;
+    }
+}
+void DccExInterface::dispatch()
+{
+    DccRxEvent e;
+    while (xQueueReceive(rxEvents, &e, 0) == pdTRUE)
+    {
+        rxMaxWait = max(rxMaxWait, (uint32_t) (micros() - e.at));
+        if (e.kind != _RX_NEGO && e.kind != _RX_TEST)
+        {
+            LinkNegotiator::heard();    // onNego() and onTest() take note themselves
+        }
+        switch (e.kind)
+        {
+        case _RX_MSG:
+            received(e.m);
+            break;
+        case _RX_ACK:
+            acked(e.m.ack);
+            break;
+        case _RX_URGENT:
+            onUrgent(e.m);
+            break;
+        case _RX_URGENT_ACK:
+            urgentAcked(e.m.mid);
+            break;
+        case _RX_NEGO:
+            LinkNegotiator::onNego(e.m.mid, e.m.client, e.m.ack);
+            break;
+        case _RX_RESET:
+            onReset(e.m.mid);
+            break;
+        case _RX_RESET_ACK:
+            onResetAck(e.m.mid);
+            break;
+        case _RX_TEST:
+            LinkNegotiator::onTest(e.m.mid, e.m.client, e.m.ack, e.m.rid);
+            break;
+        }
+    }
 }
+#endif
 /**
  * @brief           init the serial com port with the command/network station as well as the
  *                  queues if needed
@@ -76,34 +360,257 @@ void foofunc2(DccMessage msg)
  * @param _speed    Baud rate at which to communicate with the command/network station
  */
 auto DccExInterface::setup(HardwareSerial *_s, uint32_t _speed) -> void
+{
+    setup(new UartLink(_s), _speed);
+}
+/**
+ * @brief           init the link with the command/network station as well as the queues
+ *
+ * @param l         link to the other station
+ * @param _speed    baud rate or bus clock of the link
+ */
+void DccExInterface::setup(DccLink *l, uint32_t _speed)
 {
     INFO(F("Setting up DccEx Network interface connection ..." CR));
-    s = _s;                      // Serial port used for com depends on the wiring
+    link = l;                    // link used for com depends on the wiring
+    links[0] = link;
+    comp = link->protocol();
     speed = _speed;              // speed of the connection
-    s->begin(speed);             // start the serial port at the given baud rate
-    outgoing = new _tDccQueue(); // allocate space for the Queues
-    incomming = new _tDccQueue();
-    MsgPacketizer::subscribe(*s, recv_index, &foofunc2);
+    for (byte k = 0; k < nLinks; k++)
+    {
+        if (!links[k]->begin(speed))
+        {
+            ERR(F("Link [%d] to the %s could not be started" CR), k, comStationNames[sta == _NWSTA ? _DCCSTA : _NWSTA]);
+        }
+    }
+    static const size_t lanes[DCCI_LANES] = DCCI_LANE_CAPACITY;
+    outgoing = new _tDccQueue(lanes); // allocate space for the Queues
+    incomming = new _tDccQueue(lanes);
+#ifndef DCCI_CS
+    clients = new _tDccClientQueue();
+#endif
+#ifdef DCCI_RX_ASYNC
+    if (nLinks == 1 && rxOwner == nullptr)      // the manual feed has one decoder for all streams
+    {
+        // the decoder runs in the UART event task; the callbacks only hand the messages over to the loop.
+        // Everything onRx() uses is set up before the UART events are turned on as the other station may be sending already
+        rxEvents = xQueueCreate(DCCI_RX_QUEUE, sizeof(DccRxEvent));
+        rxOwner = this;
+        auto post = [this](DccMessage &m) { this->post(_RX_MSG, m); };
+        Packetizer::subscribe_manual(recv_index, [this, post](const uint8_t *data, const size_t size) {
+            unpackFrame(data, size, false, post);                      // raw frames; see DccMessage::unpack()
+        });
+        Packetizer::subscribe_manual(batch_index, [this, post](const uint8_t *data, const size_t size) {
+            unpackFrame(data, size, true, post);
+        });
+        MsgPacketizer::subscribe_manual(ack_index, [this](int ack) {
+            DccMessage m;
+            m.ack = ack;
+            this->post(_RX_ACK, m);
+        });
+        Packetizer::subscribe_manual(urgent_index, [this](const uint8_t *data, const size_t size) {
+            unpackFrame(data, size, false, [this](DccMessage &m) { this->post(_RX_URGENT, m); });
+        });
+        MsgPacketizer::subscribe_manual(urgent_ack_index, [this](int id) {
+            DccMessage m;
+            m.mid = id;
+            this->post(_RX_URGENT_ACK, m);
+        });
+        MsgPacketizer::subscribe_manual(nego_index, [this](int op, int32_t a, int32_t b) {
+            DccMessage m;
+            m.mid = op;
+            m.client = a;
+            m.ack = b;
+            this->post(_RX_NEGO, m);
+        });
+        MsgPacketizer::subscribe_manual(reset_index, [this](int e) {
+            DccMessage m;
+            m.mid = e;
+            this->post(_RX_RESET, m);
+        });
+        MsgPacketizer::subscribe_manual(reset_ack_index, [this](int e) {
+            DccMessage m;
+            m.mid = e;
+            this->post(_RX_RESET_ACK, m);
+        });
+        MsgPacketizer::subscribe_manual(test_index, [this](int32_t seq, int32_t w0, int32_t w1, int32_t crc) {
+            DccMessage m;
+            m.mid = seq;
+            m.client = w0;
+            m.ack = w1;
+            m.rid = crc;
+            this->post(_RX_TEST, m);
+        });
+        rxAsync = link->onReceive(&DccExInterface::onRx);
+        if (!rxAsync)
+        {
+            rxOwner = nullptr;
+            vQueueDelete(rxEvents);
+            rxEvents = nullptr;
+        }
+    }
+    if (!rxAsync)
+#endif
+    {
+        // the callbacks run in the loop (MsgPacketizer::update()) and go to this interface
+        for (byte k = 0; k < nLinks; k++)
+        {
+            Packetizer::subscribe(*links[k], recv_index, [this](const uint8_t *data, const size_t size) {
+                onFrame(data, size, false);                            // raw frames; see DccMessage::unpack()
+            });
+            Packetizer::subscribe(*links[k], batch_index, [this](const uint8_t *data, const size_t size) {
+                onFrame(data, size, true);
+            });
+            MsgPacketizer::subscribe(*links[k], ack_index, [this](int ack) {
+                LinkNegotiator::heard();
+                acked(ack);                                            // couldn't be piggybacked on a message
+            });
+            Packetizer::subscribe(*links[k], urgent_index, [this](const uint8_t *data, const size_t size) {
+                LinkNegotiator::heard();
+                unpackFrame(data, size, false, [this](DccMessage &m) { onUrgent(m); });
+            });
+            MsgPacketizer::subscribe(*links[k], urgent_ack_index, [this](int id) {
+                LinkNegotiator::heard();
+                urgentAcked(id);
+            });
+        }
+        MsgPacketizer::subscribe(*link, reset_index, [this](int e) {
+            LinkNegotiator::heard();
+            onReset(e);
+        });
+        MsgPacketizer::subscribe(*link, reset_ack_index, [this](int e) {
+            LinkNegotiator::heard();
+            onResetAck(e);
+        });
+        MsgPacketizer::subscribe(*link, nego_index, &LinkNegotiator::onNego);
+        MsgPacketizer::subscribe(*link, test_index, &LinkNegotiator::onTest);
+    }
+    unacked = new DccMessage[DCCI_RING];
+    held = new DccMessage[DCCI_RING];
+    for (byte i = 0; i < DCCI_RING; i++)
+    {
+        held[i].len = 0xFF;             // free
+    }
+    LinkNegotiator::setup(link, speed, sta == _NWSTA && DCCI_NEGOTIATE);
+    epoch = newEpoch();
+    urgentId = epoch;            // the other station may still hold the id of the last one of our previous run
+    resetRetry();                // the other station restarts its sequence for us
     init = true; // interface has been initatlized
     INFO(F("Setup of %s done ..." CR), comStationNames[sta]);
 }
+bool DccExInterface::addLink(DccLink *l)
+{
+    if (init || nLinks == DCCI_MAX_LINKS)
+    {
+        ERR(F("Link can't be added; at most %d links before setup()" CR), DCCI_MAX_LINKS);
+        return false;
+    }
+    links[nLinks++] = l;
+    return true;
+}
+/**
+ * @brief messages of a client go over the same link; throttle commands by loco so that the commands for one
+ * loco from several throttles stay together
+ */
+byte DccExInterface::stripe(DccMessage &m)
+{
+    if (nLinks == 1)
+    {
+        return 0;
+    }
+    uint16_t key = m.client;
+    DccOp op;
+    if (lane(m) == _LANE_THROTTLE &&
+        (DccExCodec::isBinary(m.msg) ? DccExCodec::decode(m.msg, m.len, op) : DccExCodec::parse(m.msg, op)) && op.n >= 3)
+    {
+        key = op.p[op.n - 3];           // cab of <t [reg] cab speed dir>
+    }
+    return key % nLinks;
+}
+/**
+ * @brief keeps a message which arrived ahead of the one expected; with several links a message can overtake 
+ * the ones send before it over another link
+ */
+void DccExInterface::hold(DccMessage &m)
+{
+    int16_t d = (int16_t) (uint16_t) ((uint16_t) m.mid - expected);
+    if (nLinks == 1 || d <= 0 || d >= DCCI_RING)
+    {
+        return;
+    }
+    byte free = DCCI_RING;
+    for (byte i = 0; i < DCCI_RING; i++)
+    {
+        if (held[i].len != 0xFF && (uint16_t) held[i].mid == (uint16_t) m.mid)
+        {
+            return;                     // already held
+        }
+        if (held[i].len == 0xFF)
+        {
+            free = i;
+        }
+    }
+    if (free < DCCI_RING)
+    {
+        held[free] = m;
+        reordered++;
+        gaps--;                         // not lost; counted as reordered instead
+    }
+}
+void DccExInterface::release()
+{
+    bool found = true;
+    while (found)
+    {
+        found = false;
+        for (byte i = 0; i < DCCI_RING; i++)
+        {
+            if (held[i].len == 0xFF)
+            {
+                continue;
+            }
+            int16_t d = (int16_t) (uint16_t) ((uint16_t) held[i].mid - expected);
+            if (d < 0)
+            {
+                held[i].len = 0xFF;     // got it again in between
+            }
+            else if (d == 0 && !incomming->isFull(lane(held[i])))
+            {
+                incomming->push(lane(held[i]), held[i]);
+                held[i].len = 0xFF;
+                expected++;
+                found = true;
+            }
+        }
+    }
+}
 /**
  * @brief process all that is in the incomming queue and reply
  *
  */
 auto DccExInterface::recieve() -> void
 {
-    if (!DCCI.getQueue(IN)->isEmpty())
+    if (!incomming->isEmpty())
     {
-        DccMessage m = DCCI.getQueue(IN)->pop();
+        DccMessage m = incomming->pop();
         // if recieved from self then we have an issue
         if (m.sta == sta)
         {
             ERR(F("Wrong sender; Msg seems to have been send to self; Msg has been ignored" CR));
             return;
         }
+        if (stopPending && lane(m) == _LANE_THROTTLE)
+        {
+            if ((int16_t) (uint16_t) ((uint16_t) m.mid - stopMid) < 0)
+            {
+                TRC(F("Throttle message [%d] send before the stop; ignored" CR), m.mid);
+                overtaken++;
+                return;                 // the stop has been executed already
+            }
+            stopPending = false;        // the lane is in order; the ones after this are newer as well
+        }
         TRC("Sending to handler" CR);
-        handlers[m.p](m);
+        handlers[m.p](*this, m);
     }
     return;
 }    
@@ -113,26 +620,61 @@ auto DccExInterface::recieve() -> void
  * @param c  client from which the message was orginally recieved
  * @param p  protocol for the CS DCC(JMRI), WITHROTTLE etc ..
  * @param msg the messsage ( outgoing i.e. going to the CS i.e. will mostly be functional payloads plus diagnostics )
+ * @param rid for a reply the mid of the command it answers
  */
-void DccExInterface::queue(uint16_t c, csProtocol p, char *msg)
+void DccExInterface::queue(uint16_t c, csProtocol p, char *msg, int rid)
 {
 
-    MsgPack::str_t s = MsgPack::str_t(msg);
-
     DccMessage m;
+    m.rid = rid;
 
     m.sta = static_cast<int>(sta);
     m.client = c;
     m.p = static_cast<int>(p);
-    m.msg = s;
-    m.mid = seq++;
+    int n = 0;
+    if (binary && (p == _DCCEX || p == _REPLY))
+    {
+        n = DccExCodec::encode(msg, m.msg, MAX_MESSAGE_SIZE);
+    }
+    if (n > 0)
+    {
+        m.len = n;
+    }
+    else if (!m.set(msg))
+    {
+        WARN(F("Message [%d] truncated to %d characters" CR), m.mid, MAX_MESSAGE_SIZE - 1);
+    }
 
-    INFO(F("Queuing [%d:%d:%s]:[%s]" CR), m.mid, m.client, decode((csProtocol)m.p), m.msg.c_str());
+    INFO(F("Queuing [%d:%d:%s]:[%s]%s" CR), lane(m), m.client, decode((csProtocol)m.p), msg, n > 0 ? " binary" : "");
     // MsgPacketizer::send(Serial1, 0x12, m);
 
-    outgoing->push(m);
+#ifndef DCCI_CS
+    if (!clients->push(c, m))
+    {
+        WARN(F("Queue of client [%x] is full; Message hasn't been queued" CR), c);
+        refused++;
+    }
+#else
+    outgoing->push(lane(m), m);
+#endif
     return;
 }
+bool DccExInterface::isFull(uint16_t c)
+{
+#ifndef DCCI_CS
+    return clients->isFull(c);
+#else
+    return outgoing->isFull(_LANE_ACCESSORY);
+#endif
+}
+bool DccExInterface::setWeight(uint16_t c, uint8_t w)
+{
+#ifndef DCCI_CS
+    return clients->setWeight(c, w);
+#else
+    return false;
+#endif
+}
 /**
  * @brief queue a DccMessage where the payload corresponds to the csProtocl specified. The first parameter
  * specfies if the message shall be queued in the incomming our outgoing queue
@@ -143,19 +685,19 @@ void DccExInterface::queue(uint16_t c, csProtocol p, char *msg)
  */
 void DccExInterface::queue(queueType q, csProtocol p, DccMessage packet)
 {
-    packet.mid = seq++; //  @todo shows that we actually shall package app payload with ctlr payload
-                        // user part just specifies the app payload the rest get added around as
-                        // wrapper here
+    //  @todo shows that we actually shall package app payload with ctlr payload
+    // user part just specifies the app payload the rest get added around as
+    // wrapper here; the mid is set when the message is send
     packet.sta = static_cast<int>(sta);
     packet.p = static_cast<int>(p);
 
     switch (q)
     {
     case IN:
-        if (!incomming->isFull())
+        if (!incomming->isFull(lane(packet)))
         {
             // still space available
-            incomming->push(packet);
+            incomming->push(lane(packet), packet);
         }
         else
         {
@@ -163,10 +705,10 @@ void DccExInterface::queue(queueType q, csProtocol p, DccMessage packet)
         }
         break;
     case OUT:
-        if (!outgoing->isFull())
+        if (!outgoing->isFull(lane(packet)))
         {
             // still space available
-            outgoing->push(packet);
+            outgoing->push(lane(packet), packet);
         }
         else
         {
@@ -179,31 +721,479 @@ void DccExInterface::queue(queueType q, csProtocol p, DccMessage packet)
     }
 }
 /**
- * @brief write pending messages in the outgoing queue to the serial connection
- *
+ * @brief in synchronous mode the next command waits for the reply to the previous one (or its timeout) so that
+ * the CS never has more than one command of the NetworkStation to work on; pipelined mode allows pipeline commands
+ * to be outstanding. The replies are handled in the order the commands have been send as the link delivers in order.
+ * Messages which aren't answered (control, replies on the CS and the commands without a reply of their own, see
+ * Correlator::isCommand()) are never held back.
+ */
+bool DccExInterface::mayWrite(DccMessage &m)
+{
+#ifndef DCCI_CS
+    if (Correlator::isCommand(m))
+    {
+        return Correlator::pending() < (blocking ? 1 : pipeline);
+    }
+#endif
+    return true;
+}
+/**
+ * @brief write pending messages in the outgoing queue to the serial connection. Each loop packs as many
+ * queued messages as fit into DCCI_BATCH_BYTES into one frame so that the frame overhead is shared and the 
+ * queue is drained at the rate commands come in. A single message is send in a frame of its own as before.
+ * Messages are only taken from the queue while less than window messages per link are waiting for their acknowledgement.
  */
 void DccExInterface::write()
 {
-    // while (!outgoing->empty()) {  // empty the queue
-    if (!outgoing->isEmpty())
-    { // be nice and only write one at a time
-        // only send to the Serial port if there is something in the queu
-        // TRC(F(" -> Memory" CR));
-        DccMessage m = outgoing->pop();
-        TRC(F("Sending [%d:%d:%d]: %s" CR), m.mid, m.client, m.p, m.msg.c_str());
-        // TRC(F("Sending Message... " CR));
-        MsgPacketizer::send(*s, 0x34, m);
-        // TRC(F(" Memory ->" CR));
+    if (LinkNegotiator::isActive() || !synced)
+    {
+        return;                                 // the link speed changes or the other station doesn't know our sequence yet
+    }
+#ifndef DCCI_CS
+    // the clients take turns for the space left in the lanes; a full lane only holds back the messages for it
+    clients->drain([this](DccMessage &m) {
+        if (outgoing->isFull(lane(m)))
+        {
+            return false;
+        }
+        outgoing->push(lane(m), m);
+        return true;
+    });
+#endif
+    retransmit();
+    if (outgoing->isEmpty())
+    {
+        waiting = false;
+        sendAck();
+        return;
+    }
+    if (!waiting)
+    {
+        waiting = true;
+        since = millis();
     }
+    if (inFlight >= window * nLinks || (outgoing->size() < DCCI_BATCH_MAX && millis() - since < DCCI_BATCH_DELAY))
+    {
+        sendAck();
+        return;                                 // wait for acknowledgements or for more messages to fill the frame
+    }
+    static DccBatch batch[DCCI_MAX_LINKS];    // one frame per link; packed in place
+    size_t n = 0;
+    for (byte k = 0; k < nLinks; k++)
+    {
+        batch[k].clear();
+    }
+    while (!outgoing->isEmpty() && inFlight < window * nLinks)
+    {
+        byte i = (head + inFlight) % DCCI_RING;
+        unacked[i] = outgoing->peek();          // kept until acknowledged
+        if (!mayWrite(unacked[i]))
+        {
+            break;                              // waiting for replies
+        }
+        unacked[i].mid = seq;                   // numbered in the order send; the lanes reorder the queue
+        unacked[i].ack = (uint16_t) (expected - 1);
+        byte k = stripe(unacked[i]);
+        if (!batch[k].add(unacked[i]))
+        {
+            break;                              // next frame
+        }
+        outgoing->pop();
+        seq++;
+        inFlight++;
+        n++;
+        sentAt[i] = millis();
+#ifndef DCCI_CS
+        if (Correlator::isCommand(unacked[i]))
+        {
+            Correlator::sent(unacked[i]);
+        }
+#endif
+        striped[k]++;
+        TRC(F("Sending [%d:%d:%d]: %s" CR), unacked[i].mid, unacked[i].client, unacked[i].p, DccExCodec::isBinary(unacked[i].msg) ? "<bin>" : unacked[i].msg);
+    }
+    if (n == 0)
+    {
+        sendAck();
+        return;
+    }
+    for (byte k = 0; k < nLinks; k++)
+    {
+        if (batch[k].n > 0)
+        {
+            send(batch[k], k);
+        }
+    }
+    waiting = !outgoing->isEmpty();             // what is left has already waited; goes with the next loop
     return;
 };
+/**
+ * @brief sends the messages of the batch in one frame over links[k]; they carry the latest acknowledgement
+ */
+void DccExInterface::send(DccBatch &batch, byte k)
+{
+    ackPending = false;
+    txAt = millis();
+    if (batch.n == 1)
+    {
+        Packetizer::send(*links[k], recv_index, batch.data + 1, batch.size - 1);
+    }
+    else
+    {
+        Packetizer::send(*links[k], batch_index, batch.data, batch.size);
+    }
+}
+/**
+ * @brief go back N: if the oldest message hasn't been acknowledged within DCCI_RTO it and all the 
+ * messages send after it are send again. The reciever drops everything after a gap so that
+ * the messages are processed in order and only once
+ */
+void DccExInterface::retransmit()
+{
+    if (inFlight == 0 || millis() - sentAt[head] < DCCI_RTO)
+    {
+        return;
+    }
+    WARN(F("No acknowledgement for message [%d]; Sending [%d] messages again" CR), unacked[head].mid, inFlight);
+    if (++rtoFails == DCCI_RTO_FAILS)
+    {
+        rtoFails = 0;
+        LinkNegotiator::lost();                 // the other station has probably fallen back already
+    }
+    static DccBatch batch;
+    batch.clear();
+    for (byte k = 0; k < inFlight; k++)
+    {
+        byte i = (head + k) % DCCI_RING;
+        unacked[i].ack = (uint16_t) (expected - 1);
+        if (!batch.add(unacked[i]))
+        {
+            send(batch);
+            batch.clear();
+            batch.add(unacked[i]);
+        }
+        sentAt[i] = millis();
+        retransmits++;
+    }
+    send(batch);
+}
+/**
+ * @brief sends the acknowledgement on its own if there was no message to piggyback it on for DCCI_ACK_DELAY
+ */
+void DccExInterface::sendAck()
+{
+    if (!ackPending || millis() - ackSince < DCCI_ACK_DELAY)
+    {
+        return;
+    }
+    int ack = (uint16_t) (expected - 1);
+    MsgPacketizer::send(*link, ack_index, ack);
+    ackPending = false;
+    txAt = millis();
+}
+/**
+ * @brief repeats the last acknowledgement if nothing has been send for DCCI_KEEPALIVE ms so that the other 
+ * station can tell an idle link from a broken one (see LinkNegotiator)
+ */
+void DccExInterface::keepAlive()
+{
+    if (!synced || LinkNegotiator::isActive() || millis() - txAt < DCCI_KEEPALIVE)
+    {
+        return;
+    }
+    int ack = (uint16_t) (expected - 1);
+    MsgPacketizer::send(*link, ack_index, ack);
+    txAt = millis();
+}
+/**
+ * @brief releases the messages up to and including the mid ack; acknowledgements for mids which 
+ * haven't been send are ignored
+ */
+void DccExInterface::acked(uint16_t ack)
+{
+    while (inFlight > 0)
+    {
+        int16_t d = (int16_t) (uint16_t) (ack - (uint16_t) unacked[head].mid);
+        if (d < 0 || d >= inFlight)
+        {
+            break;
+        }
+#ifndef DCCI_CS
+        Correlator::acked(unacked[head].mid);
+#endif
+        head = (head + 1) % DCCI_RING;
+        inFlight--;
+        rtoFails = 0;
+    }
+}
+/**
+ * @brief accepts only the message with the mid expected next; duplicates and messages after a gap 
+ * are dropped and the acknowledgement is send again. A restart of the other station is announced by its
+ * reset (see onReset()), not guessed from the distance of the mid.
+ * 
+ * @return true if the message shall be processed
+ */
+bool DccExInterface::inOrder(DccMessage &m)
+{
+    acked(m.ack);
+    int16_t d = (int16_t) (uint16_t) ((uint16_t) m.mid - expected);
+    if (!ackPending)
+    {
+        ackPending = true;
+        ackSince = millis();
+    }
+    if (d < 0)
+    {
+        duplicates++;
+        return false;
+    }
+    if (d > 0)
+    {
+        gaps++;
+        return false;
+    }
+    if (incomming->isFull(lane(m)))
+    {
+        ERR(F("Incomming queue is full; Message [%d] will be send again" CR), m.mid);
+        return false;
+    }
+    expected++;
+    return true;
+}
+/**
+ * @brief a random epoch; the same one after a restart would be taken for a repeated reset
+ */
+uint16_t DccExInterface::newEpoch()
+{
+    uint16_t e = 0;
+    while (e == 0)
+    {
+#ifdef ARDUINO_ARCH_ESP32
+        e = esp_random();
+#else
+        e = (uint16_t) (micros() ^ ((uint32_t) analogRead(A0) << 8) ^ random(0x10000));  // the ADC noise differs from start to start
+#endif
+    }
+    return e;
+}
+/**
+ * @brief announces the start of this station until the other one has answered; it then expects our mids from 0
+ */
+void DccExInterface::resetRetry()
+{
+    if (synced || (init && (LinkNegotiator::isActive() || millis() - resetAt < DCCI_RESET_RETRY)))
+    {
+        return;
+    }
+    int e = epoch;
+    MsgPacketizer::send(*link, reset_index, e);
+    resetAt = millis();
+}
+/**
+ * @brief the other station has started: it expects our messages from mid 0 and starts its own from 0. What we had in
+ * flight went to its previous run and is dropped; a reset repeated because our answer got lost is only answered
+ */
+void DccExInterface::onReset(uint16_t e)
+{
+    if (e != peerEpoch)
+    {
+        if (peerEpoch != 0 || inFlight > 0 || expected != 0)
+        {
+            WARN(F("%s restarted; [%d] messages in flight dropped" CR), decode(sta == _NWSTA ? _DCCSTA : _NWSTA), inFlight);
+            restarts++;
+        }
+        peerEpoch = e;
+        lost += inFlight;
+        head = 0;
+        inFlight = 0;
+        seq = 0;
+        expected = 0;
+        ackPending = false;
+        urgentRx = 0xFFFF;
+        stopPending = false;
+        for (byte i = 0; i < DCCI_RING; i++)
+        {
+            held[i].len = 0xFF;
+        }
+#ifndef DCCI_CS
+        Correlator::clear();    // the mids restart from 0 as well
+        StateMirror::resync();
+#endif
+    }
+    int ack = e;
+    MsgPacketizer::send(*link, reset_ack_index, ack);
+}
+void DccExInterface::onResetAck(uint16_t e)
+{
+    if (!synced && e == epoch)
+    {
+        synced = true;
+        INFO(F("Link to the %s synchronised" CR), decode(sta == _NWSTA ? _DCCSTA : _NWSTA));
+    }
+}
+/**
+ * @brief <!>, <0> and <0 MAIN> are the commands which must not wait for anything. Powering off another track 
+ * (e.g. <0 PROG>) leaves the locos on the main running so their throttle messages must not be dropped; it 
+ * goes through the queues
+ */
+bool DccExInterface::isUrgent(const char *cmd)
+{
+    if (cmd[0] != '<')
+    {
+        return false;
+    }
+    if (cmd[1] == '!' && cmd[2] == '>')
+    {
+        return true;
+    }
+    if (cmd[1] != '0')
+    {
+        return false;
+    }
+    const char *c = &cmd[2];
+    while (*c == ' ')
+    {
+        c++;
+    }
+    if (strncmp(c, "MAIN", 4) == 0)
+    {
+        c += 4;
+        while (*c == ' ')
+        {
+            c++;
+        }
+    }
+    return *c == '>';
+}
+/**
+ * @brief writes an emergency stop / power off to the serial link right away; it doesn't go through the 
+ * queues, the batching or the window and is acknowledged on its own. It is send again every DCCI_URGENT_RETRY ms
+ * until acknowledged. The throttle messages still queued are dropped; the ones already send carry a mid before 
+ * the seq passed along in rid and are ignored by the other station, so no speed set before the stop follows it.
+ *
+ * @param rxMicros micros() when the command has been recieved from the network
+ */
+void DccExInterface::urgent(uint16_t c, csProtocol p, char *msg, uint32_t rxMicros)
+{
+    urgentMsg = DccMessage();
+    urgentMsg.sta = static_cast<int>(sta);
+    urgentMsg.client = c;
+    urgentMsg.p = static_cast<int>(p);
+    urgentMsg.mid = ++urgentId;
+    urgentMsg.rid = seq;
+    urgentMsg.set(msg);
+    sendUrgent();
+    size_t n = outgoing->clear(_LANE_THROTTLE);
+#ifndef DCCI_CS
+    n += clients->drop([](DccMessage &m) { return lane(m) == _LANE_THROTTLE; });
+    Correlator::cancel(_LANE_THROTTLE);     // the CS ignores the queries send before the stop; a reply still coming is unmatched
+#endif
+    overtaken += n;
+    urgentSentAt = micros();
+    urgentLatency = urgentSentAt - rxMicros;
+    maxUrgentLatency = max(maxUrgentLatency, urgentLatency);
+    urgentPending = true;
+    urgentTries = 1;
+    urgents++;
+    INFO(F("Urgent [%d:%x]:[%s] send after [%d]us" CR), urgentId, c, msg, urgentLatency);
+}
+void DccExInterface::sendUrgent()
+{
+    uint8_t frame[DCCI_MSG_BYTES];
+    Packetizer::send(*link, urgent_index, frame, urgentMsg.pack(frame));
+}
+void DccExInterface::urgentRetry()
+{
+    if (!urgentPending || micros() - urgentSentAt < (uint32_t) urgentTries * DCCI_URGENT_RETRY * 1000UL)
+    {
+        return;
+    }
+    if (urgentTries == DCCI_URGENT_TRIES)
+    {
+        ERR(F("Urgent [%d] not acknowledged by %s" CR), urgentId, decode(sta == _NWSTA ? _DCCSTA : _NWSTA));
+        urgentPending = false;
+        return;
+    }
+    sendUrgent();
+    urgentTries++;
+}
+/**
+ * @brief executes the urgent message right away; one send again because the acknowledgement got lost is 
+ * only acknowledged
+ */
+void DccExInterface::onUrgent(DccMessage &m)
+{
+    if ((uint16_t) m.mid != urgentRx)
+    {
+        urgentRx = m.mid;
+        stopMid = m.rid;
+        stopPending = true;
+        if (m.p >= 0 && m.p < UNKNOWN_CS_PROTOCOL)
+        {
+            handlers[m.p](*this, m);
+        }
+    }
+    int id = m.mid;
+    MsgPacketizer::send(*link, urgent_ack_index, id);
+}
+void DccExInterface::urgentAcked(uint16_t id)
+{
+    if (urgentPending && id == urgentId)
+    {
+        urgentAckLatency = micros() - urgentSentAt;
+        urgentPending = false;
+    }
+}
+void DccExInterface::printStats()
+{
+    INFO(F("Queues: [%d] messages refused as their client's queue was full" CR), refused);
+    INFO(F("Link: [%d] retransmits [%d] duplicates [%d] gaps [%d] reordered; [%d] in flight" CR), retransmits, duplicates, gaps, reordered, inFlight);
+    INFO(F("  [%d] restarts of the other station; [%d] messages lost with them" CR), restarts, lost);
+    uint32_t total = 0;
+    uint32_t busiest = 0;
+    for (byte k = 0; k < nLinks; k++)
+    {
+        INFO(F("  link [%d]: [%d] messages" CR), k, striped[k]);
+        total += striped[k];
+        busiest = max(busiest, striped[k]);
+    }
+    if (nLinks > 1 && busiest > 0)
+    {
+        // messages send per message on the busiest link; nLinks if they are spread evenly, 1 if one link takes all
+        uint32_t gain = total * 100 / busiest;
+        INFO(F("  striping gain [%d.%02d] over [%d] links" CR), gain / 100, gain % 100, nLinks);
+    }
+    INFO(F("  speed: [%d]; [%d] messages/s in the self-test" CR), LinkNegotiator::speed, LinkNegotiator::rate);
+    INFO(F("  rx: [%d] overruns [%d]us max wait for the loop" CR), rxOverruns, rxMaxWait);
+    INFO(F("  urgent: [%d] send; last [%d]us to the link max [%d]us; acknowledged after [%d]us" CR), urgents, urgentLatency, maxUrgentLatency, urgentAckLatency);
+    INFO(F("  [%d] throttle messages dropped as a stop overtook them" CR), overtaken);
+}
 void DccExInterface::loop()
 {
+    for (byte k = 0; k < nLinks; k++)
+    {
+        links[k]->poll();
+    }
+#ifdef DCCI_RX_ASYNC
+    if (rxAsync)
+    {
+        dispatch();  // messages decoded in the driver task since the last loop; acknowledgements first so that write() can use the window
+    }
+#endif
+    LinkNegotiator::loop();
+    resetRetry();
+    urgentRetry();
+    keepAlive();
     write();   // write things the outgoing queue to Serial to send to the party on the other end of the line
     recieve(); // read things from the incomming queue and process the messages any repliy is put into the outgoing queue
     // update();    // check the com port read what is avalable and push the messages into the incomming queue
 
-    MsgPacketizer::update(); // send back replies and get commands/trigger the callback
+#ifdef DCCI_RX_ASYNC
+    if (!rxAsync)
+#endif
+    {
+        MsgPacketizer::update(); // send back replies and get commands/trigger the callback
+    }
 };
 auto DccExInterface::decode(csProtocol p) -> const char *
 {
@@ -225,26 +1215,122 @@ auto DccExInterface::decode(comStation s) -> const char *
     }
     return comStationNames[s];
 }
-auto DccExInterface::dccexHandler(DccMessage m) -> void
+/**
+ * @brief the replies of the CommandStation on power, loco, turnout and sensor state are the ones
+ * DCC-EX broadcasts to all its clients
+ */
+bool DccExInterface::isBroadcast(const char *msg)
 {
-    INFO(F("Processing message from [%s]:[%s]" CR), DCCI.decode(static_cast<comStation>(m.sta)), m.msg.c_str());
+    if (msg[0] != '<')
+    {
+        return false;
+    }
+    switch (msg[1])
+    {
+    case 'p':   // power
+    case 'l':   // loco speed and functions
+    case 'H':   // turnout
+    case 'Q':   // sensor active
+    case 'q':   // sensor inactive
+        return true;
+    default:
+        return false;
+    }
+}
+/**
+ * @brief returns the payload of m as text; the binary form is decoded into buffer
+ *
+ * @return the text or nullptr if the binary form is invalid
+ */
+const char *DccExInterface::text(DccMessage &m, char *buffer, int size)
+{
+    if (!DccExCodec::isBinary(m.msg))
+    {
+        return m.msg;
+    }
+    DccOp op;
+    if (!DccExCodec::decode(m.msg, m.len, op))
+    {
+        ERR(F("Invalid binary message [%d]; Message ignored" CR), m.mid);
+        return nullptr;
+    }
+    DccExCodec::toText(op, buffer, size);
+    return buffer;
+}
+/**
+ * @brief classifies a message for the priority lanes by its protocol and opcode so that a stop or power 
+ * off never waits behind programming track reads or diagnostics
+ */
+byte DccExInterface::lane(DccMessage &m)
+{
+    switch (m.p)
+    {
+    case _CTRL:
+        return _LANE_CTRL;
+    case _DIAG:
+        return _LANE_PROG;
+    case _WITHROTTLE:
+        return _LANE_THROTTLE;
+    default:
+        break;
+    }
+    switch (DccExCodec::opcode(m.msg))
+    {
+    case '!':   // emergency stop
+    case '0':   // power off
+    case '1':   // power on
+    case 'p':   // power state
+        return _LANE_CTRL;
+    case 't':   // throttle
+    case 'F':   // function
+    case 'f':
+    case 'l':   // loco state
+        return _LANE_THROTTLE;
+    case 'R':   // read cv
+    case 'W':   // write cv
+    case 'w':   // write cv on main
+    case 'B':   // write cv bit
+    case 'b':   // write cv bit on main
+    case 'V':   // verify cv
+    case 'r':   // cv read result
+    case 'D':   // diagnostics
+        return _LANE_PROG;
+    default:
+        return _LANE_ACCESSORY;
+    }
+}
+auto DccExInterface::dccexHandler(DccExInterface &dcci, DccMessage m) -> void
+{
+    DccOp op;
+    if (dcci.opHandler != nullptr && DccExCodec::isBinary(m.msg) && DccExCodec::decode(m.msg, m.len, op))
+    {
+        dcci.opHandler(m, op);        // opcode and parameters are ready; no text to scan
+        return;
+    }
+    char cmd[MAX_MESSAGE_SIZE];
+    const char *c = text(m, cmd, sizeof(cmd));
+    if (c == nullptr)
+    {
+        return;
+    }
+    INFO(F("Processing message from [%s]:[%s]" CR), dcci.decode(static_cast<comStation>(m.sta)), c);
     // send to the DCC part he commands and get the reply
     char buffer[MAX_MESSAGE_SIZE] = {0};
-    sprintf(buffer, "reply from CS: %d:%d:%s", m.client, m.mid, m.msg.c_str());
-    DCCI.queue(m.client, _REPLY, buffer);
+    snprintf(buffer, sizeof(buffer), "reply from CS: %d:%d:%s", m.client, m.mid, c);
+    dcci.queue(m.client, _REPLY, buffer, m.mid);
 };
-auto DccExInterface::wiThrottleHandler(DccMessage m) -> void{};
-auto DccExInterface::ctrlHandler(DccMessage m) -> void {
+auto DccExInterface::wiThrottleHandler(DccExInterface &dcci, DccMessage m) -> void{};
+auto DccExInterface::ctrlHandler(DccExInterface &dcci, DccMessage m) -> void {
     // where does the message come from
-    INFO(F("Recieved CTRL message from %s" CR), DCCI.decode((comStation) m.sta));
+    INFO(F("Recieved CTRL message from %s" CR), dcci.decode((comStation) m.sta));
     switch(m.sta) {
         case _DCCSTA: {
             // we are on the NW station handling a message from the commandstation
             break;
         }
         case _NWSTA: {
-            TRC(F("Executing CTRL message %s" CR), m.msg.c_str());
-            Cmds.run(m.msg.c_str());
+            TRC(F("Executing CTRL message %s" CR), m.msg);
+            Cmds.run(m.msg);
             // we are on the CommandStation handling a message from the NetworkStation
             // so the message shall have the form <! opcode yy zz >
             // get the opcode and get the function to handle it from the opcode hashmap
@@ -255,7 +1341,7 @@ auto DccExInterface::ctrlHandler(DccMessage m) -> void {
         }
     }
 };
-auto DccExInterface::notYetHandler(DccMessage m) -> void
+auto DccExInterface::notYetHandler(DccExInterface &dcci, DccMessage m) -> void
 {
     if (m.p == UNKNOWN_CS_PROTOCOL)
     {
@@ -263,70 +1349,40 @@ auto DccExInterface::notYetHandler(DccMessage m) -> void
     }
     else
     {
-        WARN(F("%s Message protocol not supported on %s; Message ignored" CR), DCCI.decode((csProtocol)m.p), DCCI.decode((comStation)m.sta));
+        WARN(F("%s Message protocol not supported on %s; Message ignored" CR), dcci.decode((csProtocol)m.p), dcci.decode((comStation)m.sta));
     }
     return;
 };
 #ifndef DCCI_CS // only valid on the NW station
-auto DccExInterface::replyHandler(DccMessage m) -> void
+auto DccExInterface::replyHandler(DccExInterface &dcci, DccMessage m) -> void
 {
 
-    INFO(F("Processing reply from the CommandStation for client [%d]..." CR), m.client);
+    INFO(F("Processing reply from the CommandStation for client [%x]..." CR), m.client);
 
-    // search for the client in the network ... There must be a better way
-    // and send the reply now to the connected client ...
-
-    byte nt = network->getNumberOfTransports();              // #of networkinterfaces which have been instantiated
-    transportType *tt = network->getArrayOfTransportTypes(); // for each of the interfaces we know the transport type
-
-    for (byte i = 0; i < nt; i++)
+    char buffer[MAX_MESSAGE_SIZE];
+    const char *reply = text(m, buffer, sizeof(buffer));
+    if (reply == nullptr)
     {
-        switch (tt[i])
-        {
-        case WIFI:
-        {
-            WiFiTransport *wt = static_cast<WiFiTransport *>(network->transports[i]);
-            if (wt->getActive() == 0)
-                break; // nothing to be done no clients
-            WiFiClient wtc = wt->getClient(m.client);
-            if (wtc.connected())
-            {
-                wtc.write(m.msg.c_str());
-                wtc.write(CR); // CR -> just so that we have a nl in the terminal ...
-            }
-            else
-            {
-                WARN(F("WiFi client not connected. Can't send reply" CR));
-            }
-            break;
-        }
-        case ETHERNET:
-        {
-            EthernetTransport *et = static_cast<EthernetTransport *>(network->transports[i]);
-            if (et->getActive() == 0)
-                break; // nothing to be done no clients
-            EthernetClient etc = et->getClient(m.client);
-            if (etc.connected())
-            {
-                etc.write(m.msg.c_str());
-                etc.write(CR);
-            }
-            else
-            {
-                WARN(F("Ethernet client not connected. Can't send reply" CR));
-            }
-            break;
-        }
-        default:
-        {
-            ERR(F("Unknown transport protocol must be either WIFI or ETHERNET"));
-            break;
-        }
-        }
+        return;
+    }
+    m.client = Correlator::replied(m);
+    StateMirror::update(m.client, reply);
+    if (m.client == 0)
+    {
+        return;                         // reply to a sync query of the state mirror
+    }
+    // the client handle holds the transport and the slot of the connection
+    if (!network->write(m.client, reply))
+    {
+        WARN(F("Reply for client [%x] could not be delivered" CR), m.client);
+    }
+    if (isBroadcast(reply))
+    {
+        network->broadcast(reply);
     }
 }
-auto DccExInterface::diagHandler(DccMessage m) -> void{
-    INFO(F("Recieved DIAG: %s" CR), m.msg.c_str());
+auto DccExInterface::diagHandler(DccExInterface &dcci, DccMessage m) -> void{
+    INFO(F("Recieved DIAG: %s" CR), m.msg);
 };
 #endif
 DccExInterface::DccExInterface(){};
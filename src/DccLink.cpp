@@ -0,0 +1,145 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "DccLink.h"
+
+/**
+ * @brief the Wire bus of the board (e.g. the touch controller of the display) keeps its pins; a link set up on
+ * them would take them over or never see a clean signal
+ */
+bool DccLink::onWirePins(const int *pins, byte n)
+{
+#ifdef ARDUINO_ARCH_ESP32
+    for (byte i = 0; i < n; i++)
+    {
+        if (pins[i] == SDA || pins[i] == SCL)
+        {
+            ERR(F("Link pin [%d] is used by the Wire bus; see DCCI_SPI_* and DCCI_I2C_* in DCSIconfig.h" CR), pins[i]);
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+bool UartLink::begin(uint32_t speed)
+{
+#ifdef ARDUINO_ARCH_ESP32
+    s->setRxBufferSize(DCCI_RX_RING);   // has to be set before begin()
+#endif
+    s->begin(speed);
+    return true;
+}
+
+bool UartLink::onReceive(void (*callback)())
+{
+#ifdef ARDUINO_ARCH_ESP32
+    s->onReceive(callback);             // runs in the UART event task
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UartLink::setSpeed(uint32_t speed)
+{
+#ifdef ARDUINO_ARCH_ESP32
+    s->updateBaudRate(speed);
+#else
+    s->end();
+    s->begin(speed);
+#endif
+    return true;
+}
+
+size_t UartLink::read(uint8_t *buffer, size_t size)
+{
+#ifdef ARDUINO_ARCH_ESP32
+    return s->read(buffer, size);
+#else
+    return DccLink::read(buffer, size);
+#endif
+}
+
+size_t FramedLink::write(uint8_t b)
+{
+    if (!tx.push(b))
+    {
+        overruns++;
+        return 0;
+    }
+    return 1;
+}
+
+size_t FramedLink::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(buffer[n]) == 1)
+    {
+        n++;
+    }
+    return n;
+}
+
+int FramedLink::fill(uint8_t *frame, int size)
+{
+    int n = 0;
+    while (n < size - 1 && tx.pop(frame[1 + n]))
+    {
+        n++;
+    }
+    frame[0] = n;
+    return n + 1;
+}
+
+void FramedLink::take(const uint8_t *frame, int size)
+{
+    int n = min((int) frame[0], size - 1);
+    for (int i = 1; i <= n; i++)
+    {
+        if (!rx.push(frame[i]))
+        {
+            overruns += n - i + 1;
+            return;
+        }
+    }
+}
+
+size_t LoopbackLink::write(uint8_t b)
+{
+    if (peer == nullptr || !peer->rx.push(b))
+    {
+        overruns++;
+        return 0;
+    }
+    return 1;
+}
+
+size_t LoopbackLink::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(buffer[n]) == 1)
+    {
+        n++;
+    }
+    return n;
+}
@@ -22,6 +22,7 @@
 #include <WiFi.h>
 
 #include "EthernetSetup.h"
+#include "LinkMonitor.h"
 
 #define Ethernet ETH    // rename externally provided Class instance)
 
@@ -34,15 +35,15 @@ static bool eth_connected = false;
 void WiFiEvent(WiFiEvent_t event)
 {
   switch (event) {
-    case SYSTEM_EVENT_ETH_START:
+    case ARDUINO_EVENT_ETH_START:
       Serial.println("ETH Started");
       //set eth hostname here
       ETH.setHostname("esp32-ethernet");
       break;
-    case SYSTEM_EVENT_ETH_CONNECTED:
+    case ARDUINO_EVENT_ETH_CONNECTED:
       Serial.println("ETH Connected");
       break;
-    case SYSTEM_EVENT_ETH_GOT_IP:
+    case ARDUINO_EVENT_ETH_GOT_IP:
       Serial.print("ETH MAC: ");
       Serial.print(ETH.macAddress());
       Serial.print(", IPv4: ");
@@ -55,11 +56,11 @@ void WiFiEvent(WiFiEvent_t event)
       Serial.println("Mbps");
       eth_connected = true;
       break;
-    case SYSTEM_EVENT_ETH_DISCONNECTED:
+    case ARDUINO_EVENT_ETH_DISCONNECTED:
       Serial.println("ETH Disconnected");
       eth_connected = false;
       break;
-    case SYSTEM_EVENT_ETH_STOP:
+    case ARDUINO_EVENT_ETH_STOP:
       Serial.println("ETH Stopped");
       eth_connected = false;
       break;
@@ -72,7 +73,8 @@ byte EthernetSetup::setup() {
     
     TRC("Ethernet Setup::setup() ... " CR);
 
-    WiFi.onEvent(WiFiEvent); // doesn't seem to have any effect on the Ethernet side
+    WiFi.onEvent(WiFiEvent); // events are delivered with the ARDUINO_EVENT ids; the legacy SYSTEM_EVENT ids don't match
+    LinkMonitor::setup();
     // check for the WiFi if that does someting 
     
     if (!Ethernet.begin()) {
@@ -82,12 +84,13 @@ byte EthernetSetup::setup() {
     Ethernet.fullDuplex();
   
 // check below on all sorts of error conditions ...
-    INFO(F("Starting server on Ethernet connection ..." CR));
-    server = new EthernetServer(port);
-    server->begin();
-    server->available();
+    if (protocol != MQTT)
+    {
+        INFO(F("Starting server on Ethernet connection ..." CR));
+        server = startServer(port);
+    }
     connected = true;
-    maxConnections = MAX_SOCK_NUM;
+    maxConnections = MAX_SOCK_NUM;              // for MQTT the number of remote clients mapped to the slots
   
     if (connected)
     {
@@ -102,6 +105,20 @@ byte EthernetSetup::setup() {
     return false; // something went wrong
 }
 
+/**
+ * @brief the server is bound to the address of the Ethernet interface so that it doesn't take the clients of 
+ * the WiFi listening on the same port. Without an address yet (DHCP) it is started by the transport once the 
+ * link is up
+ */
+EthernetServer *EthernetSetup::startServer(uint16_t p) {
+    IPAddress ip = LinkMonitor::localIP(ETHERNET);
+    EthernetServer *s = new EthernetServer(ip, p, MAX_SOCK_NUM);
+    if ((uint32_t) ip != 0) {
+        s->begin();
+    }
+    return s;
+}
+
 void EthernetSetup::print() {
    Log.trace("EthernetSetup::server: %x" CR, server);
    Log.trace("EthernetSetup::udp: %x" CR, udp);
@@ -0,0 +1,67 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "I2cLink.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+
+I2cLink *I2cLink::active = nullptr;
+
+bool I2cLink::begin(uint32_t speed)
+{
+    static const int pins[] = {DCCI_I2C_SDA, DCCI_I2C_SCL};
+    if (onWirePins(pins, 2))
+    {
+        return false;
+    }
+    active = this;
+    wire->onReceive(&I2cLink::onWrite);
+    wire->onRequest(&I2cLink::onRead);
+    if (!wire->begin((uint8_t) DCCI_I2C_ADDRESS, DCCI_I2C_SDA, DCCI_I2C_SCL, speed))
+    {
+        ERR(F("I2C slave setup at [%x] failed" CR), DCCI_I2C_ADDRESS);
+        return false;
+    }
+    INFO(F("I2C slave link at [%x]: frames of [%d] bytes" CR), DCCI_I2C_ADDRESS, DCCI_I2C_FRAME);
+    return true;
+}
+
+void I2cLink::onWrite(int n)
+{
+    while (active->wire->available() > 0)
+    {
+        if (!active->rx.push(active->wire->read()))
+        {
+            active->overruns++;
+        }
+    }
+}
+
+void I2cLink::onRead()
+{
+    uint8_t frame[DCCI_I2C_FRAME];
+    int len = active->fill(frame, sizeof(frame));
+    active->wire->write(frame, len);
+    active->frames++;
+}
+
+#endif
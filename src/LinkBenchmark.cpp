@@ -0,0 +1,86 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "LinkBenchmark.h"
+#include "DccExInterface.h"
+#include "Correlator.h"
+
+benchPhase LinkBenchmark::phase = _BENCH_IDLE;
+uint16_t   LinkBenchmark::n = 0;
+uint16_t   LinkBenchmark::sent = 0;
+uint32_t   LinkBenchmark::start = 0;
+uint32_t   LinkBenchmark::elapsed[2] = {0, 0};
+bool       LinkBenchmark::blocking = DCCI_BLOCKING;
+
+void LinkBenchmark::run(uint16_t commands)
+{
+    if (phase != _BENCH_IDLE)
+    {
+        WARN(F("Link benchmark already running" CR));
+        return;
+    }
+    n = commands > 0 ? commands : 1;
+    blocking = DCCI.isBlocking();
+    INFO(F("Link benchmark: [%d] commands per mode" CR), n);
+    begin(_BENCH_SYNC);
+}
+
+void LinkBenchmark::begin(benchPhase p)
+{
+    phase = p;
+    sent = 0;
+    DCCI.setBlocking(p == _BENCH_SYNC);
+    start = micros();
+}
+
+void LinkBenchmark::loop()
+{
+    if (phase == _BENCH_IDLE)
+    {
+        return;
+    }
+    // keep the queue filled; the mode decides how many go over the link
+    while (sent < n && !DCCI.isFull(0))
+    {
+        DCCI.queue(0, _DCCEX, (char *) "<#>");
+        sent++;
+    }
+    if (sent < n || DCCI.size(OUT) > 0 || Correlator::pending() > 0)
+    {
+        return;
+    }
+    elapsed[phase - _BENCH_SYNC] = micros() - start;
+    if (phase == _BENCH_SYNC)
+    {
+        begin(_BENCH_PIPELINED);
+        return;
+    }
+    DCCI.setBlocking(blocking);
+    phase = _BENCH_IDLE;
+    for (byte m = 0; m < 2; m++)
+    {
+        uint32_t us = max(elapsed[m], (uint32_t) 1);
+        INFO(F("  %s: [%d] commands in [%d]us; [%d] commands/s [%d]us per command" CR), m == 0 ? "synchronous" : "pipelined",
+             n, us, (uint32_t) ((uint64_t) n * 1000000UL / us), us / n);
+    }
+    Correlator::printStats();
+}
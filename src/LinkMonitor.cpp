@@ -0,0 +1,72 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <ETH.h>
+#include <WiFi.h>
+#include <DCSIlog.h>
+
+#include "LinkMonitor.h"
+
+volatile bool LinkMonitor::up[2] = {false, false};
+bool LinkMonitor::registered = false;
+
+/**
+ * @brief runs in the network event task; only sets the flags the transports check in their loop
+ * 
+ * @param event 
+ */
+void LinkMonitor::onEvent(WiFiEvent_t event)
+{
+    switch (event)
+    {
+    case ARDUINO_EVENT_ETH_GOT_IP:
+        up[ETHERNET] = true;
+        break;
+    case ARDUINO_EVENT_ETH_DISCONNECTED:
+    case ARDUINO_EVENT_ETH_LOST_IP:
+    case ARDUINO_EVENT_ETH_STOP:
+        up[ETHERNET] = false;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        up[WIFI] = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        up[WIFI] = false;
+        break;
+    default:
+        break;
+    }
+}
+
+void LinkMonitor::setup()
+{
+    if (registered)
+    {
+        return;
+    }
+    WiFi.onEvent(onEvent);
+    registered = true;
+}
+
+IPAddress LinkMonitor::localIP(transportType t)
+{
+    return (t == ETHERNET) ? ETH.localIP() : WiFi.localIP();
+}
@@ -0,0 +1,313 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "LinkNegotiator.h"
+#include "MsgPacketizer.h"
+
+#define NEGO_INDEX  0x39        // DccExInterface::nego_index
+#define TEST_INDEX  0x3A        // DccExInterface::test_index
+
+static const uint32_t speeds[] = DCCI_SPEEDS;
+static const byte nSpeeds = sizeof(speeds) / sizeof(speeds[0]);
+
+DccLink   *LinkNegotiator::link = nullptr;
+bool      LinkNegotiator::initiator = false;
+negoState LinkNegotiator::state = _NEGO_IDLE;
+byte      LinkNegotiator::step = 0;
+uint32_t  LinkNegotiator::since = 0;
+uint32_t  LinkNegotiator::confirmed = 0;
+uint32_t  LinkNegotiator::base = 0;
+bool      LinkNegotiator::alive = false;
+bool      LinkNegotiator::negotiable = false;
+bool      LinkNegotiator::negotiate = false;
+uint32_t  LinkNegotiator::heardAt = 0;
+uint32_t  LinkNegotiator::trial = 0;
+uint32_t  LinkNegotiator::burstStart = 0;
+uint16_t  LinkNegotiator::good = 0;
+uint16_t  LinkNegotiator::bad = 0;
+uint32_t  LinkNegotiator::speed = 0;
+uint32_t  LinkNegotiator::rate = 0;
+uint16_t  LinkNegotiator::errors = 0;
+
+/**
+ * @brief CRC16-CCITT over the little endian bytes of the words of a test frame
+ */
+uint16_t LinkNegotiator::crc16(int32_t seq, int32_t w0, int32_t w1)
+{
+    int32_t words[3] = {seq, w0, w1};
+    uint16_t crc = 0xFFFF;
+    for (byte w = 0; w < 3; w++)
+    {
+        for (byte i = 0; i < 4; i++)
+        {
+            crc ^= (uint16_t) ((words[w] >> (8 * i)) & 0xFF) << 8;
+            for (byte b = 0; b < 8; b++)
+            {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+        }
+    }
+    return crc;
+}
+
+void LinkNegotiator::setup(DccLink *l, uint32_t s, bool i)
+{
+    link = l;
+    speed = s;
+    confirmed = s;
+    base = s;
+    initiator = i;
+    negotiable = initiator && link->setSpeed(speed);  // false if it follows or the link has no speed to negotiate
+    negotiate = negotiable;
+}
+
+/**
+ * @brief steps up from the current speed; called once the other station is alive
+ */
+void LinkNegotiator::start()
+{
+    negotiate = false;
+    step = 0;
+    while (step < nSpeeds && speeds[step] <= speed)
+    {
+        step++;
+    }
+    if (step == nSpeeds)
+    {
+        return;
+    }
+    INFO(F("Negotiating the link speed from [%d]" CR), speed);
+    propose();
+}
+
+void LinkNegotiator::send(int op, int32_t a, int32_t b)
+{
+    MsgPacketizer::send(*link, NEGO_INDEX, op, a, b);
+}
+
+void LinkNegotiator::propose()
+{
+    trial = speeds[step];
+    send(_NEGO_PROPOSE, trial);
+    state = _NEGO_PROPOSING;
+    since = millis();
+}
+
+/**
+ * @brief test frames with a pattern changing with each frame so that stuck or shifted bits show
+ */
+void LinkNegotiator::burst()
+{
+    burstStart = micros();
+    for (int32_t seq = 0; seq < DCCI_TEST_FRAMES; seq++)
+    {
+        int32_t w0 = 0x55AA55AA ^ (seq * 0x9E3779B1);
+        int32_t w1 = ~w0;
+        int32_t crc = crc16(seq, w0, w1);
+        MsgPacketizer::send(*link, TEST_INDEX, seq, w0, w1, crc);
+    }
+    send(_NEGO_REPORT_REQ, DCCI_TEST_FRAMES);
+    state = _NEGO_TESTING;
+    since = millis();
+}
+
+void LinkNegotiator::finish()
+{
+    send(_NEGO_DONE, confirmed);
+    state = _NEGO_IDLE;
+    INFO(F("Link speed settled at [%d]: [%d] messages/s; [%d] test frames lost or corrupted" CR), speed, rate, errors);
+}
+
+void LinkNegotiator::heard()
+{
+    heardAt = millis();
+    if (!alive)
+    {
+        alive = true;
+        INFO(F("Link alive at [%d]" CR), speed);
+    }
+}
+
+void LinkNegotiator::lost()
+{
+    if (state != _NEGO_IDLE)
+    {
+        return;                                 // the negotiation has its own timeouts
+    }
+    alive = false;
+    negotiate = negotiable;
+    if (speed != base)
+    {
+        WARN(F("Link lost at [%d]; falling back to [%d]" CR), speed, base);
+        link->setSpeed(speed = base);
+        confirmed = base;
+    }
+}
+
+void LinkNegotiator::loop()
+{
+    uint32_t now = millis();
+    switch (state)
+    {
+    case _NEGO_IDLE:
+        if (alive && now - heardAt > DCCI_LINK_SILENCE)
+        {
+            WARN(F("No frame from the other station for [%d]ms" CR), now - heardAt);
+            lost();
+        }
+        else if (alive && negotiate)
+        {
+            start();
+        }
+        break;
+    case _NEGO_PROPOSING:
+        if (now - since > DCCI_NEGO_TIMEOUT)
+        {
+            WARN(F("[%d] not accepted by the other station" CR), trial);
+            finish();
+        }
+        break;
+    case _NEGO_SETTLING:
+        if (now - since > DCCI_NEGO_SETTLE)
+        {
+            burst();
+        }
+        break;
+    case _NEGO_TESTING:
+        if (now - since > DCCI_NEGO_TIMEOUT)
+        {
+            WARN(F("No report at [%d]; falling back to [%d]" CR), trial, confirmed);
+            errors += DCCI_TEST_FRAMES;
+            link->setSpeed(speed = confirmed);
+            state = _NEGO_REVERTING;
+            since = now;
+        }
+        break;
+    case _NEGO_REVERTING:
+        if (now - since > 2 * DCCI_NEGO_TIMEOUT)
+        {
+            finish();                           // the other station has fallen back by now
+        }
+        break;
+    case _NEGO_TRIAL:
+        if (now - since > DCCI_NEGO_TIMEOUT)
+        {
+            WARN(F("Link speed [%d] not confirmed; falling back to [%d]" CR), speed, confirmed);
+            link->setSpeed(speed = confirmed);
+            state = _NEGO_IDLE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void LinkNegotiator::onNego(int op, int32_t a, int32_t b)
+{
+    since = millis();
+    heard();
+    switch (op)
+    {
+    // follower
+    case _NEGO_PROPOSE:
+        if (state == _NEGO_TRIAL)
+        {
+            confirmed = speed;                  // it has been clean at the trial speed
+        }
+        send(_NEGO_ACCEPT, a);
+        link->flush();                          // the accept goes out at the old speed
+        if (!link->setSpeed(a))
+        {
+            return;
+        }
+        speed = a;
+        good = bad = 0;
+        state = _NEGO_TRIAL;
+        break;
+    case _NEGO_REPORT_REQ:
+        send(_NEGO_REPORT, good, bad);
+        break;
+    case _NEGO_DONE:
+        confirmed = a;
+        if (speed != confirmed)
+        {
+            link->setSpeed(speed = confirmed);
+        }
+        state = _NEGO_IDLE;
+        INFO(F("Link speed set to [%d] by the other station" CR), speed);
+        break;
+    // initiator
+    case _NEGO_ACCEPT:
+        if (state != _NEGO_PROPOSING || a != (int32_t) trial)
+        {
+            return;
+        }
+        link->setSpeed(speed = trial);
+        state = _NEGO_SETTLING;
+        break;
+    case _NEGO_REPORT:
+    {
+        if (state != _NEGO_TESTING)
+        {
+            return;
+        }
+        uint32_t us = (uint32_t) (micros() - burstStart) | 1;
+        uint32_t perSecond = (uint32_t) ((uint64_t) a * 1000000UL / us);
+        uint16_t lost = DCCI_TEST_FRAMES - a;
+        INFO(F("  [%d]: [%d] messages/s; [%d] of [%d] test frames lost or corrupted" CR), trial, perSecond, lost, DCCI_TEST_FRAMES);
+        errors += lost;
+        if (lost > 0)
+        {
+            link->setSpeed(speed = confirmed);
+            state = _NEGO_REVERTING;
+            break;
+        }
+        confirmed = trial;
+        rate = perSecond;
+        if (++step < nSpeeds)
+        {
+            propose();
+        }
+        else
+        {
+            finish();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void LinkNegotiator::onTest(int32_t seq, int32_t w0, int32_t w1, int32_t crc)
+{
+    since = millis();
+    heard();
+    if (crc16(seq, w0, w1) == (uint16_t) crc)
+    {
+        good++;
+    }
+    else
+    {
+        bad++;
+    }
+}
@@ -0,0 +1,201 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+#include <Config.h>
+
+#include "MqttSession.h"
+
+#define MQTT_CMD_TOPIC      MQTT_ROOT "/cmd/"
+#define MQTT_REPLY_TOPIC    MQTT_ROOT "/reply/"
+#define MQTT_BROADCAST      MQTT_ROOT "/broadcast"
+#define MQTT_STATUS         MQTT_ROOT "/status"
+#define BROADCAST_BATCH     MAX_SOCK_NUM
+
+void MqttSession::setup(uint16_t p, uint8_t s, void *o, MqttReceiver r)
+{
+    port = p;
+    slots = s;
+    owner = o;
+    receiver = r;
+    memset(ids, 0, sizeof(ids));
+    mqtt.setClient(net);
+    mqtt.setServer(MQTT_BROKER, port);
+    mqtt.setBufferSize(MQTT_PACKET_SIZE);
+    mqtt.setKeepAlive(MQTT_KEEPALIVE);
+    mqtt.setSocketTimeout(MQTT_SOCKET_TIMEOUT);   // don't block the other transports for the default 15s if the broker is gone
+    mqtt.setCallback([this](char *topic, uint8_t *payload, unsigned int len) { received(topic, payload, len); });
+    INFO(F("MQTT broker:           [%s:%d]" CR), MQTT_BROKER, port);
+    connect();
+}
+
+/**
+ * @brief connects to the broker with a persistent session; the subscription and the commands published with QoS1
+ * while we were away are kept by the broker. The status topic tells the clients if the NetworkStation is there.
+ */
+void MqttSession::connect()
+{
+    lastAttempt = millis();
+    if (!mqtt.connect(MQTT_CLIENT_ID, MQTT_USER, MQTT_PWD, MQTT_STATUS, 1, true, "offline", false))
+    {
+        WARN(F("MQTT connection to [%s:%d] failed; state [%d]" CR), MQTT_BROKER, port, mqtt.state());
+        return;
+    }
+    mqtt.publish(MQTT_STATUS, (const uint8_t *) "online", 6, true);
+    if (!mqtt.subscribe(MQTT_CMD_TOPIC "+", 1))
+    {
+        ERR(F("MQTT subscription to [%s] failed" CR), MQTT_CMD_TOPIC "+");
+    }
+    INFO(F("MQTT connected as [%s]" CR), MQTT_CLIENT_ID);
+}
+
+void MqttSession::loop()
+{
+    if (!mqtt.connected())
+    {
+        if (millis() - lastAttempt < MQTT_RECONNECT)
+        {
+            return;
+        }
+        connect();
+        return;
+    }
+    mqtt.loop();
+    uint32_t now = millis();
+    for (byte b = 0; b <= BROADCAST_BATCH; b++)
+    {
+        if (batches[b].len > 0 && now - batches[b].since >= MQTT_BATCH_DELAY)
+        {
+            flush(b);
+        }
+    }
+}
+
+/**
+ * @brief commands from the remote clients; the client id is the last level of the topic
+ */
+void MqttSession::received(char *topic, uint8_t *payload, unsigned int len)
+{
+    if (strncmp(topic, MQTT_CMD_TOPIC, sizeof(MQTT_CMD_TOPIC) - 1) != 0)
+    {
+        return;
+    }
+    const char *id = &topic[sizeof(MQTT_CMD_TOPIC) - 1];
+    if (*id == 0 || strlen(id) >= MQTT_ID_LENGTH)
+    {
+        WARN(F("Invalid MQTT client id in [%s]; Command ignored" CR), topic);
+        return;
+    }
+    bool isNew = false;
+    int slot = slotOf(id, isNew);
+    TRC(F("MQTT [%s] -> slot [%d]: %d bytes" CR), id, slot, len);
+    receiver(owner, slot, isNew, payload, len);
+}
+
+int MqttSession::slotOf(const char *id, bool &isNew)
+{
+    int lru = 0;
+    for (byte i = 0; i < slots; i++)
+    {
+        if (strcmp(ids[i], id) == 0)
+        {
+            seen[i] = millis();
+            return i;
+        }
+        if (ids[lru][0] != 0 && (ids[i][0] == 0 || (int32_t) (seen[i] - seen[lru]) < 0))
+        {
+            lru = i;
+        }
+    }
+    if (ids[lru][0] != 0)
+    {
+        INFO(F("MQTT client [%s] replaced by [%s]" CR), ids[lru], id);
+        flush(lru);                                 // the pending replies still go to the previous client
+    }
+    strcpy(ids[lru], id);
+    seen[lru] = millis();
+    isNew = true;
+    return lru;
+}
+
+bool MqttSession::publish(uint8_t slot, const char *msg)
+{
+    if (slot >= slots || ids[slot][0] == 0)
+    {
+        return false;
+    }
+    return queue(slot, msg);
+}
+
+bool MqttSession::broadcast(const char *msg)
+{
+    return queue(BROADCAST_BATCH, msg);
+}
+
+/**
+ * @brief adds msg to the batch; a full batch is send right away
+ */
+bool MqttSession::queue(uint8_t b, const char *msg)
+{
+    MqttBatch *batch = &batches[b];
+    int len = min((int) strlen(msg), MQTT_BATCH_SIZE - 1);
+    if (batch->len + len + 1 > MQTT_BATCH_SIZE)
+    {
+        flush(b);
+    }
+    if (batch->len == 0)
+    {
+        batch->since = millis();
+    }
+    memcpy(&batch->buffer[batch->len], msg, len);
+    batch->len += len;
+    batch->buffer[batch->len++] = '\n';
+    batched++;
+    return true;
+}
+
+void MqttSession::flush(uint8_t b)
+{
+    MqttBatch *batch = &batches[b];
+    if (batch->len == 0)
+    {
+        return;
+    }
+    char topic[sizeof(MQTT_REPLY_TOPIC) + MQTT_ID_LENGTH];
+    if (b == BROADCAST_BATCH)
+    {
+        strcpy(topic, MQTT_BROADCAST);
+    }
+    else
+    {
+        snprintf(topic, sizeof(topic), MQTT_REPLY_TOPIC "%s", ids[b]);
+    }
+    // QoS0; the trailing newline of the last reply isn't send
+    if (mqtt.connected() && mqtt.publish(topic, (const uint8_t *) batch->buffer, batch->len - 1, false))
+    {
+        publishes++;
+    }
+    else
+    {
+        WARN(F("MQTT publish to [%s] failed; %d bytes dropped" CR), topic, batch->len);
+        dropped++;
+    }
+    batch->len = 0;
+}
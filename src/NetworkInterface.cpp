@@ -23,64 +23,68 @@
 #include "Transport.h"
 #include "EthernetSetup.h"
 #include "WifiSetup.h"
+#include "DccExInterface.h"
+#include "ThrottleCoalescer.h"
+#include "StateMirror.h"
+#include "Correlator.h"
+#include "LinkBenchmark.h"
 
-Transport<WiFiServer, WiFiClient, WiFiUDP> *wifiTransport;
-Transport<EthernetServer, EthernetClient, EthernetUDP> *ethernetTransport;
+WiFiTransport *wifiTransport;
+EthernetTransport *ethernetTransport;
 
-DCCNetwork NetworkInterface::_dccNet;
+DCCNet NetworkInterface::_dccNet;
 
-void DCCNetwork::loop()
+/**
+ * @brief Declares a TCP port of the transport to be setup with a fixed protocol. Clients connecting
+ * on that port don't go through the protocol detection of the tokenizer. All ports share the 
+ * connection pool of the transport
+ * 
+ * @param port 
+ * @param protocol DCCEX, WITHROTTLE, HTTP, JSON or UNDEFINED for detecting the protocol 
+ * @return false if MAX_LISTENERS ports have already been declared
+ */
+bool NetworkInterface::listen(uint16_t port, scanType protocol)
 {
-    for (byte i = 0; i < _tCounter; i++)
+    if (nListeners == MAX_LISTENERS)
     {
-        Transport<EthernetServer, EthernetClient, EthernetUDP> *e;
-        Transport<WiFiServer, WiFiClient, WiFiUDP> *w;
-
-        switch (_t[i])
-        {
-            case ETHERNET:
-            {
-                e = (Transport<EthernetServer, EthernetClient, EthernetUDP> *)transports[i];
-                e->loop();
-                break;
-            }
-            case WIFI:
-            {
-                w = (Transport<WiFiServer, WiFiClient, WiFiUDP> *)transports[i];
-                w->loop();
-                break;
-            }
-        }
+        ERR(F("Too many listeners; Port %d ignored" CR), port);
+        return false;
     }
+    listeners[nListeners].port = port;
+    listeners[nListeners].protocol = protocol;
+    nListeners++;
+    return true;
 }
 
-byte DCCNetwork::add(AbstractTransport *t, transportType transport)
+/**
+ * @brief Layout state updates (power, turnouts, locos, sensors) are send once per event to the multicast group 
+ * on the interface of the transport instead of once per client. Each datagram is "<seq>:<msg>" so that receivers 
+ * can detect lost updates; the sequence number is the same on all transports
+ */
+void NetworkInterface::multicast(uint16_t port, IPAddress group)
 {
-    if (_tCounter != MAX_INTERFACES)
-    {
-        _t[_tCounter] = transport;
-        transports[_tCounter] = t;  // add to array of network interfaces returns the index + 1 if added
-        _tCounter++;                // if max intefaces is reached returns 0 for too many ...
-        return _tCounter;           // normally a delete shall not be necessary as all is setup at the beginning and shall not change over a session
-    }
-    else
-    {
-        return 0;
-    }
+    mcastGroup = group;
+    mcastPort = port;
 }
 
 /**
  * @brief Instantiates a networkInterface for a given transport layer using a specified protocol 
- * on port. 
+ * on port or on the ports declared with listen(). 
  * 
  * @param transport 
  * @param protocol 
  * @param port 
  */
-void NetworkInterface::setup(transportType transport, protocolType protocol, uint16_t port)
+void NetworkInterface::setup(transportType transport, protocolType protocol, uint16_t port, transportProfile profile)
 {
     bool ok = false;
 
+    if (nListeners == 0)
+    {
+        listen(port, UNDEFINED);    // single port; protocol detected by the tokenizer
+    }
+    port = listeners[0].port;
+
     // Log.info
     INFO(F("[%s] Transport Setup In Progress ..." CR), transport ? "Ethernet" : "Wifi");
 
@@ -91,17 +95,25 @@ void NetworkInterface::setup(transportType transport, protocolType protocol, uin
     {
     case WIFI:
     {
-        WifiSetup wSetup(port, protocol);
+        WifiSetup wSetup(port, protocol, profile);
         if (wSetup.setup())
         {
-            wifiTransport = new Transport<WiFiServer, WiFiClient, WiFiUDP>;
-            wifiTransport->id = _dccNet.add(wifiTransport, transport);
-            wifiTransport->server = wSetup.getTCPServer();
-            wifiTransport->port = port;
+            wifiTransport = new WiFiTransport;
+            wifiTransport->id = _dccNet.add(wifiTransport);
+            wifiTransport->servers[0] = wSetup.getTCPServer();
+            for (byte i = 1; protocol == TCP && i < nListeners; i++)
+            {
+                wifiTransport->servers[i] = wSetup.startServer(listeners[i].port);
+            }
+            memcpy(wifiTransport->listeners, listeners, sizeof(listeners));
+            wifiTransport->nListeners = (protocol == TCP) ? nListeners : 1;
             wifiTransport->protocol = protocol;
             wifiTransport->transport = transport;
             wifiTransport->udp = wSetup.getUDPServer();             // 0 if TCP is used
             wifiTransport->maxConnections = wSetup.maxConnections;
+            wifiTransport->profile = profile;
+            wifiTransport->mcastGroup = mcastGroup;
+            wifiTransport->mcastPort = mcastPort;
             ok = wifiTransport->setup(this);
             TRC(F("Interface [%x] bound to transport id [%d:%x]" CR), this, wifiTransport->id, wifiTransport);
         } else {
@@ -114,14 +126,22 @@ void NetworkInterface::setup(transportType transport, protocolType protocol, uin
         EthernetSetup eSetup(port, protocol);
 
         if( eSetup.setup() ) {
-            ethernetTransport = new Transport<EthernetServer, EthernetClient, EthernetUDP>;
-            ethernetTransport->id = _dccNet.add(ethernetTransport, transport);
-            ethernetTransport->server = eSetup.getTCPServer();          // 0 if UDP is used
-            ethernetTransport->port = port;
+            ethernetTransport = new EthernetTransport;
+            ethernetTransport->id = _dccNet.add(ethernetTransport);
+            ethernetTransport->servers[0] = eSetup.getTCPServer();      // 0 if UDP is used
+            for (byte i = 1; protocol == TCP && i < nListeners; i++)
+            {
+                ethernetTransport->servers[i] = eSetup.startServer(listeners[i].port);
+            }
+            memcpy(ethernetTransport->listeners, listeners, sizeof(listeners));
+            ethernetTransport->nListeners = (protocol == TCP) ? nListeners : 1;
             ethernetTransport->protocol = protocol;
             ethernetTransport->transport = transport;
             ethernetTransport->udp = eSetup.getUDPServer();             // 0 if TCP is used
             ethernetTransport->maxConnections = eSetup.maxConnections;  // that has been determined during the ethernet/wifi setup
+            ethernetTransport->profile = profile;
+            ethernetTransport->mcastGroup = mcastGroup;
+            ethernetTransport->mcastPort = mcastPort;
             ok = ethernetTransport->setup(this);                      // start the transport i.e. setup all the client connections; We don't need the setup object anymore from here on
             TRC(F("Interface [%x] bound to transport id [%d:%x]" CR), this, ethernetTransport->id, ethernetTransport);
         } else {
@@ -143,7 +163,38 @@ void NetworkInterface::loop()
 {
     // loop over all the transports in
     _dccNet.loop();
+    ThrottleCoalescer::loop();
+    StateMirror::loop();
+    Correlator::loop();
+    LinkBenchmark::loop();
 
+    static uint32_t statsAt = 0;
+    if (STATS_INTERVAL > 0 && millis() - statsAt >= STATS_INTERVAL)
+    {
+        statsAt = millis();
+        printStats();               // counters of the transports and the link
+    }
+}
+
+/**
+ * @brief logs the counters of all transports e.g. to compare the LATENCY and THROUGHPUT profiles
+ */
+struct StatsVisitor
+{
+    template <class T>
+    void operator()(T *t)
+    {
+        t->printStats();
+    }
+};
+void NetworkInterface::printStats()
+{
+    StatsVisitor v;
+    _dccNet.visit(v);
+    DCCI.printStats();
+    ThrottleCoalescer::printStats();
+    StateMirror::printStats();
+    Correlator::printStats();
 }
 
 void NetworkInterface::setHttpCallback(HttpCallback callback)
@@ -0,0 +1,96 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "SpiLink.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+
+bool SpiLink::begin(uint32_t speed)
+{
+    static const int pins[] = {DCCI_SPI_MOSI, DCCI_SPI_MISO, DCCI_SPI_SCLK, DCCI_SPI_CS, DCCI_SPI_HANDSHAKE};
+    if (onWirePins(pins, sizeof(pins) / sizeof(pins[0])))
+    {
+        return false;
+    }
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = DCCI_SPI_MOSI;
+    bus.miso_io_num = DCCI_SPI_MISO;
+    bus.sclk_io_num = DCCI_SPI_SCLK;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    spi_slave_interface_config_t slave = {};
+    slave.mode = 0;
+    slave.spics_io_num = DCCI_SPI_CS;
+    slave.queue_size = 1;
+    esp_err_t err = spi_slave_initialize(VSPI_HOST, &bus, &slave, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK)
+    {
+        ERR(F("SPI slave setup failed [%d]" CR), err);
+        return false;
+    }
+    txFrame = (uint8_t *) heap_caps_malloc(DCCI_SPI_FRAME, MALLOC_CAP_DMA);
+    rxFrame = (uint8_t *) heap_caps_malloc(DCCI_SPI_FRAME, MALLOC_CAP_DMA);
+    pinMode(DCCI_SPI_HANDSHAKE, OUTPUT);
+    digitalWrite(DCCI_SPI_HANDSHAKE, LOW);
+    queue();
+    INFO(F("SPI slave link: frames of [%d] bytes" CR), DCCI_SPI_FRAME);
+    return true;
+}
+
+/**
+ * @brief queues the next transaction with what is waiting to be send; an empty frame if there is nothing
+ */
+void SpiLink::queue()
+{
+    fill(txFrame, DCCI_SPI_FRAME);
+    memset(&trans, 0, sizeof(trans));
+    trans.length = DCCI_SPI_FRAME * 8;
+    trans.tx_buffer = txFrame;
+    trans.rx_buffer = rxFrame;
+    busy = spi_slave_queue_trans(VSPI_HOST, &trans, 0) == ESP_OK;
+    digitalWrite(DCCI_SPI_HANDSHAKE, (busy && txFrame[0] > 0) ? HIGH : LOW);
+}
+
+/**
+ * @brief the transaction queued may be an empty frame while data has been written since; the handshake is 
+ * raised as well so that the master clocks it and the next one can carry the data
+ */
+void SpiLink::poll()
+{
+    spi_slave_transaction_t *done;
+    if (busy && spi_slave_get_trans_result(VSPI_HOST, &done, 0) == ESP_OK)
+    {
+        take(rxFrame, DCCI_SPI_FRAME);
+        frames++;
+        busy = false;
+    }
+    if (!busy)
+    {
+        queue();
+    }
+    else if (txFrame[0] == 0 && !tx.isEmpty())
+    {
+        digitalWrite(DCCI_SPI_HANDSHAKE, HIGH);
+    }
+}
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "StateMirror.h"
+#include "DccExInterface.h"
+#include "NetworkInterface.h"
+
+#define MIRROR_LOCO     0
+#define MIRROR_TURNOUT  1
+#define MIRROR_SENSOR   2
+#define MIRROR_OUTPUT   3
+#define MIRROR_POWER    4
+
+mirrorState  StateMirror::state = _MIRROR_STALE;
+uint32_t     StateMirror::since = 0;
+char         StateMirror::version[MIRROR_TEXT];
+char         StateMirror::power[MIRROR_TRACKS][MIRROR_TEXT];
+MirrorEntry  StateMirror::locos[MIRROR_LOCOS];
+MirrorEntry  StateMirror::turnouts[MIRROR_TURNOUTS];
+MirrorSensor StateMirror::outputs[MIRROR_OUTPUTS];
+MirrorSensor StateMirror::sensors[MIRROR_SENSORS];
+byte         StateMirror::nPower = 0;
+byte         StateMirror::nLocos = 0;
+byte         StateMirror::nTurnouts = 0;
+byte         StateMirror::nOutputs = 0;
+byte         StateMirror::nSensors = 0;
+bool         StateMirror::overflow[5] = {false, false, false, false, false};
+uint32_t     StateMirror::answered = 0;
+uint32_t     StateMirror::updates = 0;
+
+void StateMirror::clear()
+{
+    version[0] = 0;
+    nPower = nLocos = nTurnouts = nOutputs = nSensors = 0;
+    memset(overflow, 0, sizeof(overflow));
+}
+
+void StateMirror::resync()
+{
+    if (state != _MIRROR_STALE)
+    {
+        INFO(F("State mirror invalidated; resyncing with the CommandStation" CR));
+    }
+    clear();
+    state = _MIRROR_STALE;
+}
+
+void StateMirror::loop()
+{
+    switch (state)
+    {
+    case _MIRROR_STALE:
+    {
+        // the replies come back with the client handle 0 which is never a valid client
+        DCCI.queue(0, _DCCEX, (char *) "<s>");
+        DCCI.queue(0, _DCCEX, (char *) "<T>");
+        DCCI.queue(0, _DCCEX, (char *) "<Z>");
+        DCCI.queue(0, _DCCEX, (char *) "<Q>");
+        state = _MIRROR_SYNCING;
+        since = millis();
+        break;
+    }
+    case _MIRROR_SYNCING:
+    {
+        if (millis() - since < MIRROR_SYNC_QUIET)
+        {
+            break;
+        }
+        if (version[0] == 0)
+        {
+            WARN(F("No status from the CommandStation; State mirror sync again" CR));
+            clear();
+            state = _MIRROR_STALE;
+            break;
+        }
+        state = _MIRROR_SYNCED;
+        INFO(F("State mirror synced: [%d] turnouts [%d] sensors" CR), nTurnouts, nSensors);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+MirrorEntry *StateMirror::entryOf(MirrorEntry *table, byte &n, byte max, int id, bool &full)
+{
+    for (byte i = 0; i < n; i++)
+    {
+        if (table[i].id == id)
+        {
+            return &table[i];
+        }
+    }
+    if (n == max)
+    {
+        full = true;
+        return nullptr;
+    }
+    table[n].id = id;
+    table[n].text[0] = 0;               // nothing known yet; a state alone can't be merged into it
+    return &table[n++];
+}
+
+MirrorSensor *StateMirror::flagOf(MirrorSensor *table, byte &n, byte max, int id, bool &full)
+{
+    for (byte i = 0; i < n; i++)
+    {
+        if (table[i].id == id)
+        {
+            return &table[i];
+        }
+    }
+    if (n == max)
+    {
+        full = true;
+        return nullptr;
+    }
+    table[n].id = id;
+    table[n].active = false;
+    return &table[n++];
+}
+
+/**
+ * @brief <p0> / <p1> switches all tracks and replaces what has been known per track; <p0 PROG> replaces 
+ * the state of that track only
+ */
+void StateMirror::setPower(const char *reply)
+{
+    const char *track = &reply[3];      // " PROG>" or ">"
+    if (*track == '>')
+    {
+        nPower = 0;
+    }
+    byte i = 0;
+    while (i < nPower && strcmp(&power[i][3], track) != 0)
+    {
+        i++;
+    }
+    if (i == nPower)
+    {
+        if (nPower == MIRROR_TRACKS)
+        {
+            overflow[MIRROR_POWER] = true;
+            return;
+        }
+        nPower++;
+    }
+    copy(power[i], reply);
+}
+
+/**
+ * @brief number of parameters of a command or reply i.e. the number of spaces
+ */
+static byte params(const char *text)
+{
+    byte n = 0;
+    for (const char *c = text; *c != 0; c++)
+    {
+        n += (*c == ' ');
+    }
+    return n;
+}
+
+void StateMirror::copy(char *to, const char *reply)
+{
+    strncpy(to, reply, MIRROR_TEXT - 1);
+    to[MIRROR_TEXT - 1] = 0;
+}
+
+/**
+ * @brief the state is taken from the replies as the CommandStation formats them; the last number of a
+ * turnout reply is its state in the short <H id state> broadcast as well as in the definitions listed by <T>
+ */
+void StateMirror::update(uint16_t client, const char *reply)
+{
+    if (client == 0 && state == _MIRROR_SYNCING)
+    {
+        since = millis();
+    }
+    int id;
+    switch (reply[0] == '<' ? reply[1] : 0)
+    {
+    case 'i':
+        if (strncmp(reply, "<iDCC-EX", 8) == 0)
+        {
+            copy(version, reply);
+        }
+        break;
+    case 'p':
+        if (reply[2] != '0' && reply[2] != '1' && reply[2] != '2')
+        {
+            return;
+        }
+        setPower(reply);
+        break;
+    case 'l':
+    {
+        if (sscanf(reply, "<l %d", &id) != 1)
+        {
+            return;
+        }
+        MirrorEntry *e = entryOf(locos, nLocos, MIRROR_LOCOS, id, overflow[MIRROR_LOCO]);
+        if (e == nullptr)
+        {
+            return;
+        }
+        copy(e->text, reply);
+        break;
+    }
+    case 'H':
+    {
+        if (sscanf(reply, "<H %d", &id) != 1)
+        {
+            return;
+        }
+        MirrorEntry *e = entryOf(turnouts, nTurnouts, MIRROR_TURNOUTS, id, overflow[MIRROR_TURNOUT]);
+        if (e == nullptr)
+        {
+            return;
+        }
+        char *last = strrchr(e->text, ' ');
+        if (params(reply) == 2 && params(e->text) > 2)
+        {
+            // <H id state> for a turnout known with its definition; keep the definition
+            snprintf(last, MIRROR_TEXT - (last - e->text), "%s", strrchr(reply, ' '));
+        }
+        else
+        {
+            copy(e->text, reply);
+        }
+        break;
+    }
+    case 'Y':
+    {
+        // <Y id state> or the definition <Y id pin iflag state> listed by <Z>
+        int last;
+        if ((params(reply) != 2 && params(reply) != 4) || sscanf(reply, "<Y %d", &id) != 1 ||
+            sscanf(strrchr(reply, ' '), " %d", &last) != 1)
+        {
+            return;
+        }
+        MirrorSensor *o = flagOf(outputs, nOutputs, MIRROR_OUTPUTS, id, overflow[MIRROR_OUTPUT]);
+        if (o == nullptr)
+        {
+            return;
+        }
+        o->active = (last != 0);
+        break;
+    }
+    case 'Q':
+    case 'q':
+    {
+        if (params(reply) != 1 || sscanf(&reply[2], "%d", &id) != 1)
+        {
+            return;                     // <Q id pin pullup> is a definition, not a state
+        }
+        MirrorSensor *s = flagOf(sensors, nSensors, MIRROR_SENSORS, id, overflow[MIRROR_SENSOR]);
+        if (s == nullptr)
+        {
+            return;
+        }
+        s->active = (reply[1] == 'Q');
+        break;
+    }
+    default:
+        return;
+    }
+    updates++;
+}
+
+/**
+ * @brief answers <s>, <T>, <Q> and <t cab> if the mirror is synced and holds the complete answer
+ */
+bool StateMirror::answer(uint16_t client, const char *cmd)
+{
+    if (state != _MIRROR_SYNCED || cmd[0] != '<')
+    {
+        return false;
+    }
+    DCCNet *network = NetworkInterface::getDCCNetwork();
+    char buffer[MIRROR_TEXT];
+    int cab;
+    if (strcmp(cmd, "<s>") == 0)
+    {
+        if (overflow[MIRROR_POWER] || overflow[MIRROR_TURNOUT] || overflow[MIRROR_OUTPUT] || overflow[MIRROR_SENSOR])
+        {
+            return false;               // the answer would be incomplete
+        }
+        for (byte i = 0; i < nPower; i++)
+        {
+            network->write(client, power[i]);
+        }
+        network->write(client, version);
+        for (byte i = 0; i < nTurnouts; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "<H %d%s", turnouts[i].id, strrchr(turnouts[i].text, ' '));
+            network->write(client, buffer);
+        }
+        for (byte i = 0; i < nOutputs; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "<Y %d %d>", outputs[i].id, outputs[i].active);
+            network->write(client, buffer);
+        }
+        for (byte i = 0; i < nSensors; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "<%c %d>", sensors[i].active ? 'Q' : 'q', sensors[i].id);
+            network->write(client, buffer);
+        }
+    }
+    else if (strcmp(cmd, "<T>") == 0 && !overflow[MIRROR_TURNOUT])
+    {
+        if (nTurnouts == 0)
+        {
+            network->write(client, "<X>");
+        }
+        for (byte i = 0; i < nTurnouts; i++)
+        {
+            network->write(client, turnouts[i].text);
+        }
+    }
+    else if (strcmp(cmd, "<Q>") == 0 && !overflow[MIRROR_SENSOR])
+    {
+        if (nSensors == 0)
+        {
+            network->write(client, "<X>");
+        }
+        for (byte i = 0; i < nSensors; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "<%c %d>", sensors[i].active ? 'Q' : 'q', sensors[i].id);
+            network->write(client, buffer);
+        }
+    }
+    else if (cmd[1] == 't' && params(cmd) == 1 && sscanf(cmd, "<t %d>", &cab) == 1)
+    {
+        byte i = 0;
+        while (i < nLocos && locos[i].id != cab)
+        {
+            i++;
+        }
+        if (i == nLocos)
+        {
+            return false;               // only known from broadcasts; the CommandStation may know it
+        }
+        network->write(client, locos[i].text);
+    }
+    else
+    {
+        return false;
+    }
+    TRC(F("Answered [%s] for client [%x] from the state mirror" CR), cmd, client);
+    answered++;
+    return true;
+}
+
+void StateMirror::printStats()
+{
+    INFO(F("Mirror: %s; [%d] queries answered [%d] updates; [%d] locos [%d] turnouts [%d] outputs [%d] sensors [%d] tracks" CR),
+         state == _MIRROR_SYNCED ? "synced" : "not synced", answered, updates, nLocos, nTurnouts, nOutputs, nSensors, nPower);
+}
@@ -0,0 +1,130 @@
+/*
+ * © 2023 Gregor Baues. All rights reserved.
+ *  
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the 
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ * 
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <DCSIlog.h>
+
+#include "ThrottleCoalescer.h"
+#include "DccExCodec.h"
+
+ThrottleSlot ThrottleCoalescer::slots[THROTTLE_SLOTS];
+uint32_t ThrottleCoalescer::received = 0;
+uint32_t ThrottleCoalescer::coalesced = 0;
+uint32_t ThrottleCoalescer::stopped = 0;
+
+ThrottleSlot *ThrottleCoalescer::slotOf(uint16_t client, int cab)
+{
+    ThrottleSlot *lru = &slots[0];
+    for (byte i = 0; i < THROTTLE_SLOTS; i++)
+    {
+        ThrottleSlot *t = &slots[i];
+        if (t->client == client && t->cab == cab)
+        {
+            return t;
+        }
+        if (lru->client != 0 && (t->client == 0 || (int32_t) (t->sentAt - lru->sentAt) < 0))
+        {
+            lru = t;
+        }
+    }
+    if (lru->pending)
+    {
+        send(lru);                          // the slot is taken over; its last speed still goes out
+    }
+    lru->client = client;
+    lru->cab = cab;
+    lru->dir = -1;                          // unknown; the first command goes out right away
+    lru->pending = false;
+    return lru;
+}
+
+void ThrottleCoalescer::send(ThrottleSlot *t)
+{
+    DCCI.queue(t->client, _DCCEX, t->cmd);
+    t->sentAt = millis();
+    t->pending = false;
+}
+
+/**
+ * @brief replaces DCCI.queue() for the commands of the network clients
+ */
+void ThrottleCoalescer::queue(uint16_t client, csProtocol p, char *cmd)
+{
+    DccOp op;
+    if (p != _DCCEX || cmd[1] != 't' || !DccExCodec::parse(cmd, op) || op.n < 3 || op.n > 4)
+    {
+        DCCI.queue(client, p, cmd);
+        return;
+    }
+    received++;
+    int cab = op.p[op.n - 3];
+    int speed = op.p[op.n - 2];
+    int dir = op.p[op.n - 1];
+    ThrottleSlot *t = slotOf(client, cab);
+    if (t->pending)
+    {
+        coalesced++;                        // replaced by cmd whatever happens next
+    }
+    strncpy(t->cmd, cmd, MAX_MESSAGE_SIZE - 1);
+    t->cmd[MAX_MESSAGE_SIZE - 1] = 0;
+    bool urgent = speed <= 0 || dir != t->dir;
+    t->speed = speed;
+    t->dir = dir;
+    if (urgent || millis() - t->sentAt >= THROTTLE_INTERVAL)
+    {
+        send(t);
+        return;
+    }
+    TRC(F("Speed [%d] of cab [%d] for client [%x] held back" CR), speed, cab, client);
+    t->pending = true;
+}
+
+void ThrottleCoalescer::loop()
+{
+    uint32_t now = millis();
+    for (byte i = 0; i < THROTTLE_SLOTS; i++)
+    {
+        if (slots[i].pending && now - slots[i].sentAt >= THROTTLE_INTERVAL)
+        {
+            send(&slots[i]);
+        }
+    }
+}
+
+/**
+ * @brief an emergency stop or power off has been send; a speed held back from before must not follow it. The next
+ * command of each slot goes out right away
+ */
+void ThrottleCoalescer::clear()
+{
+    for (byte i = 0; i < THROTTLE_SLOTS; i++)
+    {
+        if (slots[i].pending)
+        {
+            stopped++;
+            slots[i].pending = false;
+        }
+        slots[i].dir = -1;
+    }
+}
+
+void ThrottleCoalescer::printStats()
+{
+    INFO(F("Throttle: [%d] speed commands recieved [%d] coalesced [%d] dropped by a stop" CR), received, coalesced, stopped);
+}
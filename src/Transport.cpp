@@ -18,20 +18,78 @@
  */
 
 #include <Arduino.h>
+#include <lwip/sockets.h>
 #include <DCSIlog.h>
 #include <Transport.h>
 #include <TransportProcessor.h>
+#include <LinkMonitor.h>
 
 extern bool diagNetwork;
 extern uint8_t diagNetworkClient;
 
+/**
+ * @brief enables TCP keepalive on the socket of the client so that the stack drops connections of clients
+ * which went away without closing the connection (e.g. a phone leaving the WiFi) after 
+ * KEEPALIVE_IDLE + KEEPALIVE_INTERVAL * KEEPALIVE_COUNT seconds
+ */
+static void keepAlive(int fd)
+{
+    int on = 1;
+    int idle = KEEPALIVE_IDLE;
+    int interval = KEEPALIVE_INTERVAL;
+    int count = KEEPALIVE_COUNT;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) < 0
+        || setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) < 0)
+    {
+        WARN(F("Keepalive could not be set for socket %d" CR), fd);
+    }
+}
+
 
-template<class S, class C, class U> 
-bool Transport<S,C,U>::setup(NetworkInterface *nw) {
+/**
+ * @brief opens a UDP socket sending to multicast groups over the interface with the address ifaddr; the
+ * datagrams don't leave the local network
+ * 
+ * @return the socket or -1
+ */
+static int multicastSocket(IPAddress ifaddr)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        ERR(F("Multicast socket could not be created" CR));
+        return -1;
+    }
+    struct in_addr addr;
+    addr.s_addr = (uint32_t) ifaddr;
+    uint8_t ttl = 1;
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) < 0
+        || setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+    {
+        WARN(F("Multicast options could not be set for socket %d" CR), fd);
+    }
+    return fd;
+}
+
+template<class S, class C, class U, transportType N> 
+bool Transport<S,C,U,N>::setup(NetworkInterface *nw) {
     t = new TransportProcessor();
     TRC("Transport::Setup ..." CR);
+    if (profile == THROUGHPUT) {
+        quantum = THROUGHPUT_QUANTUM;
+        budget = THROUGHPUT_BUDGET;
+    }
     if (protocol == TCP) { 
-        connectionPool(server);     // server should have started here so create the connection pool only for TCP though
+        connectionPool();           // servers should have started here so create the connection pool only for TCP though
+        t->udp = 0;
+        if (profile == THROUGHPUT) {
+            txRegions();
+        }
+    } else if (protocol == MQTT) {
+        connectionPool(mqtt = new MqttSession());
         t->udp = 0;
     } else {
         connectionPool(udp);
@@ -42,8 +100,29 @@ bool Transport<S,C,U>::setup(NetworkInterface *nw) {
     return true;
 } 
 
-template<class S, class C, class U> 
-void Transport<S,C,U>::loop() {
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::loop() {
+    uint32_t start = micros();
+    // follow the link of the interface the transport runs on
+    bool link = LinkMonitor::isUp(N);
+    if (link != linkUp)
+    {
+        linkUp = link;
+        if (protocol == TCP)
+        {
+            link ? linkRestored() : linkDown();
+        }
+        if (!link && mcastFd >= 0)
+        {
+            ::close(mcastFd);           // bound to the address of the lost link
+            mcastFd = -1;
+        }
+        INFO(F("[%s] link %s" CR), N == ETHERNET ? "Ethernet" : "WiFi", link ? "up" : "down");
+    }
+    if (!linkUp)
+    {
+        return;
+    }
     switch (protocol)
     {
     case UDPR:
@@ -54,43 +133,194 @@ void Transport<S,C,U>::loop() {
     case TCP:
     {
         // TRC(F("Transport: %s" CR), this->transport == WIFI ? "WIFI" : "ETHERNET"); 
-        tcpSessionHandler(server);    
+        tcpSessionHandler();    
+        break;
     };
     case MQTT:
     {
-        // MQTT
+        mqtt->loop();
         break;
     };
     }
+    uint32_t elapsed = micros() - start;
+    stats.loops++;
+    stats.loopMicros += elapsed;
+    stats.maxLoopMicros = max(stats.maxLoopMicros, elapsed);
+}
+
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::printStats() {
+    INFO(F("Transport [%d:%s:%s]" CR), id, transport == WIFI ? "WiFi" : "Ethernet", profile == LATENCY ? "latency" : "throughput");
+    INFO(F("  rx: [%d] bytes in [%d] reads; tx: [%d] bytes in [%d] writes; [%d] replies coalesced" CR), stats.rxBytes, stats.rxReads, stats.txBytes, stats.txWrites, stats.txCoalesced);
+    INFO(F("  loop: [%d] calls avg [%d]us max [%d]us" CR), stats.loops, stats.loops ? stats.loopMicros / stats.loops : 0, stats.maxLoopMicros);
+    if (mqtt != nullptr)
+    {
+        INFO(F("  mqtt: [%d] replies in [%d] publishes; [%d] dropped" CR), mqtt->batched, mqtt->publishes, mqtt->dropped);
+    }
 }
 
-template<class S, class C, class U> 
-void Transport<S, C, U>::connectionPool(S *server)
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::connectionPool()
 {
-    if( server == nullptr) {
-        ERR("Server is invalid " CR);
-        return;
+    for (int i = 0; i < nListeners; i++)
+    {
+        if( servers[i] == nullptr) {
+            ERR("Server for port %d is invalid " CR, listeners[i].port);
+            return;
+        }
     }
+    rxRegions();
     for (int i = 0; i < Transport::maxConnections; i++)
     {
-        clients[i] = server->accept();
         connections[i].client = &clients[i];              
         connections[i].id = i;
         TRC(F("TCP Connection pool:       [%d:%x]" CR), i, connections[i].client);
     }
 }
-template<class S, class C, class U> 
-void Transport<S, C, U>::connectionPool(U *udp)
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::connectionPool(U *udp)
 {
+    rxRegions();
     for (int i = 0; i < Transport::maxConnections; i++)
     {
-        clients[i] = server->accept();
         connections[i].client = &clients[i];              
         connections[i].id = i;
+        connections[i].protocol = listeners[0].protocol;
+        connections[i].gen = ClientHandle::next(connections[i].gen);
+        connections[i].handle = ClientHandle::make(id, i, connections[i].gen);
 
         TRC(F("UDP Connection pool:       [%d:%x]" CR), i, udp);
     }
 }
+/**
+ * @brief The slots of the MQTT transport are taken by the remote clients publishing commands; there are no sockets
+ * behind them
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::connectionPool(MqttSession *session)
+{
+    rxRegions();
+    for (int i = 0; i < Transport::maxConnections; i++)
+    {
+        connections[i].client = &clients[i];              
+        connections[i].id = i;
+        connections[i].protocol = listeners[0].protocol;
+    }
+    session->setup(listeners[0].port, maxConnections, this, &Transport::mqttReceive);
+}
+/**
+ * @brief Commands published by a remote MQTT client go through the receive region of its slot to the tokenizer 
+ * like the data read from a socket. A client id taking a slot gets a new handle so that replies for the previous 
+ * client of that slot are rejected.
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::mqttReceive(void *owner, uint8_t slot, bool isNew, uint8_t *payload, unsigned int len)
+{
+    uint32_t at = micros();
+    Transport *tr = static_cast<Transport *>(owner);
+    Connection *c = &tr->connections[slot];
+    if (isNew)
+    {
+        if (c->handle == 0)
+        {
+            tr->active++;
+        }
+        c->rxStart = 0;
+        c->rxEnd = 0;
+        c->gen = ClientHandle::next(c->gen);
+        c->handle = ClientHandle::make(tr->id, slot, c->gen);
+        INFO(F("New MQTT Client: [%d:%x]" CR), slot, c->handle);
+    }
+    c->lastActive = millis();
+    tr->stats.rxBytes += len;
+    tr->stats.rxReads++;
+    while (len > 0)
+    {
+        int n = min((int) len, tr->t->reserve(c));
+        memcpy(&c->rx[c->rxEnd], payload, n);
+        tr->t->scan(c, n, at);
+        payload += n;
+        len -= n;
+    }
+}
+/**
+ * @brief The link of the transport is gone; its clients can't be reached anymore so they are dropped right away 
+ * instead of waiting for the keepalive. Their slots are free for clients reconnecting once the link is back and
+ * replies still on their way are rejected. The servers are stopped as their address is lost with the link.
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::linkDown()
+{
+    for (byte i = 0; i < maxConnections; i++)
+    {
+        if (connections[i].handle != 0)
+        {
+            close(i, "link down");
+        }
+    }
+    for (byte l = 0; l < nListeners; l++)
+    {
+        servers[l]->end();
+    }
+}
+/**
+ * @brief The link is up again; start the servers bound to the address of the interface so that Ethernet and 
+ * WiFi can listen on the same ports side by side
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::linkRestored()
+{
+    IPAddress ip = LinkMonitor::localIP(N);
+    for (byte l = 0; l < nListeners; l++)
+    {
+        servers[l]->end();
+        delete servers[l];
+        servers[l] = new S(ip, listeners[l].port, maxConnections);
+        servers[l]->begin();
+        INFO(F("Listening on:          [%d.%d.%d.%d:%d]" CR), ip[0], ip[1], ip[2], ip[3], listeners[l].port);
+    }
+}
+/**
+ * @brief allocates one block for the receive regions of all connections. Data is read from the socket directly
+ * into the region of the connection and tokenized there
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::rxRegions()
+{
+    rxPool = new char[maxConnections * MAX_ETH_BUFFER];
+    for (int i = 0; i < maxConnections; i++)
+    {
+        connections[i].rx = &rxPool[i * MAX_ETH_BUFFER];
+        connections[i].rxStart = 0;
+        connections[i].rxEnd = 0;
+    }
+}
+/**
+ * @brief THROUGHPUT profile: replies to a client are collected in its send region and written together once the 
+ * region is full or the first one has waited THROUGHPUT_TX_DELAY ms; fewer writes and packets at the cost of latency
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::txRegions()
+{
+    txPool = new char[maxConnections * THROUGHPUT_TX_BUFFER];
+    for (int i = 0; i < maxConnections; i++)
+    {
+        connections[i].tx = &txPool[i * THROUGHPUT_TX_BUFFER];
+        connections[i].txLen = 0;
+    }
+}
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::flush(byte i)
+{
+    Connection *c = &connections[i];
+    if (c->txLen == 0)
+    {
+        return;
+    }
+    stats.txBytes += clients[i].write((const uint8_t *) c->tx, c->txLen);
+    stats.txWrites++;
+    c->txLen = 0;
+}
 /**
  * @todo implement UDP properly
  * 
@@ -99,9 +329,10 @@ void Transport<S, C, U>::connectionPool(U *udp)
  * @tparam U 
  */
 
-template<class S, class C, class U> 
-void Transport<S, C, U>::udpHandler(U* udp)
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::udpHandler(U* udp)
 {
+    uint32_t at = micros();
     int packetSize = udp->parsePacket();
     if (packetSize > 0)
     {
@@ -110,11 +341,12 @@ void Transport<S, C, U>::udpHandler(U* udp)
         char portBuffer[6];
         TRC(F("From: [%d.%d.%d.%d: %s]" CR), remote[0], remote[1], remote[2], remote[3], utoa(udp->remotePort(), portBuffer, 10)); // DIAG has issues with unsigend int's so go through utoa
 
-        udp->read(t->buffer, MAX_ETH_BUFFER);   
-        t->buffer[packetSize] = 0;               // terminate buffer
-        t->readStream(&connections[0], false );  // there is only one connection for UDP; reading into the buffer has been done
-
-        memset(t->buffer, 0, MAX_ETH_BUFFER);    // reset PacktBuffer
+        Connection *c = &connections[0];        // there is only one connection for UDP
+        int n = udp->read((uint8_t *) &c->rx[c->rxEnd], t->reserve(c));
+        if (n > 0) 
+        {
+            t->scan(c, n, at);
+        }
         return; 
 
         // send the reply
@@ -126,11 +358,11 @@ void Transport<S, C, U>::udpHandler(U* udp)
 }
 
 /**
- * @brief As tcpHandler but this time the connections are kept open (thus creating a statefull session) as long as the client doesn't disconnect. A connection
- * pool has been setup beforehand and determines the number of available sessions depending on the network hardware.  Commands crossing packet boundaries will be captured
+ * @brief Takes a new client from the server if there is one and stores it in a free slot of the connection 
+ * pool. The pool is shared by all the listeners of the transport; the connection gets the protocol of the listener
  */
-template<class S, class C, class U> 
-void Transport<S,C,U>::tcpSessionHandler(S* server)
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::accept(S* server, scanType p)
 {
     // get client from the server
     C client = server->accept();
@@ -138,47 +370,251 @@ void Transport<S,C,U>::tcpSessionHandler(S* server)
     // check for new client 
     if (client)
     {
-        active++;
-        for (byte i = 0; i < maxConnections; i++)
+        int i = freeSlot();
+        if (i < 0)
         {
-            if (!clients[i])
-            {
-                // On accept() the EthernetServer doesn't track the client anymore
-                // so we store it in our client array
-                clients[i] = client;
-                INFO(F("New Client: [%d:%x]" CR), i, clients[i]);
-                break;
-            }
+            WARN(F("No free connection available; Client refused" CR));
+            client.stop();
+            return;
         }
+        // On accept() the EthernetServer doesn't track the client anymore
+        // so we store it in our client array
+        clients[i] = client;
+        keepAlive(clients[i].fd());
+        clients[i].setNoDelay(profile == LATENCY);  // Nagle holds back small replies until the previous one has been acked
+        connections[i].protocol = p;
+        connections[i].deficit = 0;
+        connections[i].rxStart = 0;         // nothing left over from the previous client of the slot
+        connections[i].rxEnd = 0;
+        connections[i].lastActive = millis();
+        connections[i].idleTimeout = idleTimeout;
+        connections[i].gen = ClientHandle::next(connections[i].gen);
+        connections[i].handle = ClientHandle::make(id, i, connections[i].gen);
+        active++;
+        INFO(F("New Client: [%d:%x]" CR), i, connections[i].handle);
     }
+}
 
-    // check for incoming data from all possible clients
+/**
+ * @brief returns a free slot of the connection pool; a slot is in use as long as its connection has a handle. If all slots are taken the least recently active client
+ * is disconnected if it has been idle for at least evictMinIdle ms
+ * 
+ * @return the slot or -1 if there is none 
+ */
+template<class S, class C, class U, transportType N> 
+int Transport<S,C,U,N>::freeSlot()
+{
+    int lru = -1;
     for (byte i = 0; i < maxConnections; i++)
     {
-        if (clients[i] && clients[i].available() > 0)
+        if (connections[i].handle == 0)
         {
-            t->readStream(&connections[i], true);
+            return i;
         }
-        // stop any clients which disconnect
-        for (byte i = 0; i < maxConnections; i++)
+        if (lru < 0 || (int32_t) (connections[i].lastActive - connections[lru].lastActive) < 0)
         {
-            if (clients[i] && !clients[i].connected())
+            lru = i;
+        }
+    }
+    if (lru < 0 || millis() - connections[lru].lastActive < evictMinIdle)
+    {
+        return -1;
+    }
+    close(lru, "evicted");
+    return lru;
+}
+
+/**
+ * @brief stops the client in slot i; replies still on their way for this client will be rejected
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::close(byte i, const char *reason)
+{
+    INFO(F("Disconnect client #%d: %s" CR), i, reason);
+    clients[i].stop();
+    clients[i] = C();
+    connections[i].handle = 0;
+    connections[i].txLen = 0;       // replies collected for the client are dropped with it
+    active--;
+}
+
+/**
+ * @brief As tcpHandler but this time the connections are kept open (thus creating a statefull session) as long as the client doesn't disconnect. A connection
+ * pool has been setup beforehand and determines the number of available sessions depending on the network hardware.  Commands crossing packet boundaries will be captured
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::tcpSessionHandler()
+{
+    // check for new clients on all the ports
+    for (byte l = 0; l < nListeners; l++)
+    {
+        accept(servers[l], listeners[l].protocol);
+    }
+
+    // deficit round robin over the connections with data: each round a connection may read up to its deficit
+    // plus the quantum and keeps what it didn't use as long as it has data. The rounds start with the slot 
+    // after the one served last so that no slot always goes first. The reads stop once the budget is used or a 
+    // round hasn't read anything (a quantum of 0 set at runtime, a read failing while data is announced)
+    int left = budget;
+    uint16_t q = max(quantum, (uint16_t) 1);
+    bool more = true;
+    while (left > 0 && more)
+    {
+        more = false;
+        int round = 0;
+        byte start = next;
+        for (byte k = 0; k < maxConnections && left > 0; k++)
+        {
+            byte i = (start + k) % maxConnections;
+            Connection *c = &connections[i];
+            if (c->handle == 0 || clients[i].available() <= 0)
+            {
+                c->deficit = 0;
+                continue;
+            }
+            c->deficit = min(c->deficit + q, MAX_ETH_BUFFER - 1);
+            int n = max(t->readStream(c, min((int) c->deficit, left)), 0);
+            if (n > 0)
+            {
+                c->lastActive = millis();
+                stats.rxBytes += n;
+                stats.rxReads++;
+            }
+            c->deficit -= n;
+            left -= n;
+            round += n;
+            next = (i + 1) % maxConnections;
+            if (clients[i].available() > 0)
             {
-                INFO(F("Disconnect client #%d" CR), i);
-                clients[i].stop();
-                active--;
+                more = true;
             }
+            else
+            {
+                c->deficit = 0;
+            }
+        }
+        if (round == 0)
+        {
+            break;                  // no progress; what is left is read in the next loop
+        }
+    }
+    // stop any clients which disconnect or have been idle for too long
+    uint32_t now = millis();
+    for (byte i = 0; i < maxConnections; i++)
+    {
+        if (connections[i].handle == 0)
+        {
+            continue;               // free slot
+        }
+        if (connections[i].txLen > 0 && now - connections[i].txSince >= THROUGHPUT_TX_DELAY)
+        {
+            flush(i);
         }
+        if (!clients[i].connected())
+        {
+            close(i, "disconnected");
+        }
+        else if (connections[i].idleTimeout != 0 && now - connections[i].lastActive > connections[i].idleTimeout)
+        {
+            close(i, "idle timeout");
+        }
+    }
+}
+
+/**
+ * @brief writes a reply to the client the handle has been issued for. The slot is taken directly from 
+ * the handle; a handle of a previous client of that slot is rejected through the generation
+ */
+template<class S, class C, class U, transportType N> 
+bool Transport<S,C,U,N>::write(uint16_t handle, const char *msg)
+{
+    uint8_t slot = ClientHandle::slot(handle);
+    if (slot >= maxConnections || connections[slot].handle != handle)
+    {
+        WARN(F("Stale client handle [%x]; Reply ignored" CR), handle);
+        return false;
+    }
+    if (protocol == MQTT)
+    {
+        stats.txBytes += strlen(msg);
+        return mqtt->publish(slot, msg);    // batched; send from the loop
+    }
+    if (!clients[slot].connected())
+    {
+        WARN(F("Client #%d not connected. Can't send reply" CR), slot);
+        return false;
+    }
+    // one write for the reply and the CR -> just so that we have a nl in the terminal ... 
+    // without NODELAY the CR would otherwise wait for the ack of the reply
+    char buffer[MAX_MESSAGE_SIZE + 2];
+    int len = snprintf(buffer, sizeof(buffer), "%s" CR, msg);
+    len = min(len, (int) sizeof(buffer) - 1);
+    Connection *c = &connections[slot];
+    if (c->tx != nullptr)
+    {
+        if (c->txLen + len > THROUGHPUT_TX_BUFFER)
+        {
+            flush(slot);
+        }
+        if (c->txLen == 0)
+        {
+            c->txSince = millis();
+        }
+        else
+        {
+            stats.txCoalesced++;
+        }
+        memcpy(c->tx + c->txLen, buffer, len);
+        c->txLen += len;
+        return true;
+    }
+    stats.txBytes += clients[slot].write((const uint8_t *) buffer, len);
+    stats.txWrites++;
+    return true;
+}
+
+/**
+ * @brief Only MQTT has a topic all clients subscribe to; the clients of the other protocols get the replies to 
+ * their own commands and the layout state updates through the multicast group if there is one. The datagram is 
+ * send once whatever the number of clients listening
+ */
+template<class S, class C, class U, transportType N> 
+void Transport<S,C,U,N>::broadcast(uint32_t seq, const char *msg)
+{
+    if (protocol == MQTT && mqtt->broadcast(msg))
+    {
+        stats.txBytes += strlen(msg);
+    }
+    if (mcastPort == 0 || !linkUp)
+    {
+        return;
+    }
+    if (mcastFd < 0 && (mcastFd = multicastSocket(LinkMonitor::localIP(N))) < 0)
+    {
+        return;
+    }
+    char buffer[MAX_MESSAGE_SIZE + 12];
+    int len = snprintf(buffer, sizeof(buffer), "%u:%s", (unsigned) seq, msg);
+    len = min(len, (int) sizeof(buffer) - 1);
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(mcastPort);
+    to.sin_addr.s_addr = (uint32_t) mcastGroup;
+    if (sendto(mcastFd, buffer, len, 0, (struct sockaddr *) &to, sizeof(to)) == len)
+    {
+        stats.txBytes += len;
+        stats.txWrites++;
     }
 }
 
-template<class S, class C, class U> 
-Transport<S,C,U>::Transport(){}
+template<class S, class C, class U, transportType N> 
+Transport<S,C,U,N>::Transport(){}
 
-template<class S, class C, class U> 
-Transport<S,C,U>::~Transport(){}
+template<class S, class C, class U, transportType N> 
+Transport<S,C,U,N>::~Transport(){}
 
 
 // explicitly instatiate to get the relevant copies for ethernet / wifi build @compile time
-template class Transport<EthernetServer,EthernetClient,EthernetUDP>;
-// template class Transport<WiFiServer, WiFiClient, WiFiUDP>;
+template class Transport<EthernetServer, EthernetClient, EthernetUDP, ETHERNET>;
+template class Transport<WiFiServer, WiFiClient, WiFiUDP, WIFI>;
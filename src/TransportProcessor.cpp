@@ -23,8 +23,11 @@
 #include <DccExInterface.h>
 #include <CommandTokenizer.h>
 #include <TransportProcessor.h>
+#include <ThrottleCoalescer.h>
+#include <StateMirror.h>
 
 Connection *TransportProcessor::currentConnection;
+uint32_t TransportProcessor::rxMicros;
 
 HttpRequest httpReq;
 
@@ -84,33 +87,82 @@ void TransportProcessor::tokenHandler(scanType s, char *token) {
         }
     }
     _sseq[currentConnection->id];
-    if(queue) DCCI.queue(currentConnection->id, p, token);
+    if (queue && DccExInterface::isUrgent(token)) {
+        ThrottleCoalescer::clear();                                     // no speed held back may follow the stop
+        DCCI.urgent(currentConnection->handle, p, token, rxMicros);     // straight to the serial link
+    } else if (queue && StateMirror::answer(currentConnection->handle, token)) {
+        return;                                                         // read-only query answered locally
+    } else if (queue) {
+        ThrottleCoalescer::queue(currentConnection->handle, p, token);
+    }
 }
 /**
- * @brief Reads what is available on the incomming TCP stream and hands it over to the protocol handler.
+ * @brief Returns the space left in the receive region of the connection. An incomplete command stays where 
+ * it has been recieved; it is only moved to the start of the region if there isn't enough space left for a 
+ * full command after it.
  * 
- * @param c    Pointer to the connection struct contining relevant information handling the data from that connection
+ * @param c Connection
+ * @return int number of bytes which can be read into the region at c->rxEnd
  */
-void TransportProcessor::readStream(Connection *c, bool read)
+int TransportProcessor::reserve(Connection *c)
 {
-    
-    int count = 0;
-    // read bytes from a TCP client if required 
-    if (read) {
-        int len = c->client->read(buffer, MAX_ETH_BUFFER - 1); // count is the amount of data ready for reading, -1 if there is no data, 0 is the connection has been closed
-        buffer[len] = 0;
-        count = len;
-    } else {
-        count = strlen((char *)buffer);
+    if (MAX_ETH_BUFFER - 1 - c->rxEnd < MAX_MESSAGE_SIZE && c->rxStart > 0)
+    {
+        memmove(c->rx, &c->rx[c->rxStart], c->rxEnd - c->rxStart);
+        c->rxEnd -= c->rxStart;
+        c->rxStart = 0;
+    }
+    if (c->rxEnd == MAX_ETH_BUFFER - 1)
+    {
+        WARN(F("Client #[%d] receive buffer full; data ignored" CR), c->id);
+        c->rxStart = 0;
+        c->rxEnd = 0;
     }
-    
+    return MAX_ETH_BUFFER - 1 - c->rxEnd;       // keep one byte for terminating the data
+}
+/**
+ * @brief Tokenizes the data of the receive region of the connection in place and hands the tokens over to the 
+ * protocol handler. 
+ * 
+ * @param c Connection
+ * @param n number of bytes read at c->rxEnd
+ * @param at micros() before the data has been read; the urgent latency counts the read and the logging as well
+ */
+void TransportProcessor::scan(Connection *c, int n, uint32_t at)
+{
     IPAddress remote = c->client->remoteIP();
-    INFO(F("Client #[%d] Received packet #[%d] of size:[%d] from [%d.%d.%d.%d]" CR), c->id, _pNum, count, remote[0], remote[1], remote[2], remote[3]);
+    INFO(F("Client #[%d] Received packet #[%d] of size:[%d] from [%d.%d.%d.%d]" CR), c->id, _pNum, n, remote[0], remote[1], remote[2], remote[3]);
     _rseq[c->id]++; // increase the number of packets recieved 
+
+    rxMicros = at;
+    c->rxEnd += n;
+    c->rx[c->rxEnd] = 0;
     // tokenize the recived information and send the token to the 
     currentConnection = c;
-    tokenizer.scanCommands((char *) buffer, count, &TransportProcessor::tokenHandler);
+    c->rxStart += tokenizer.scanCommands(&c->rx[c->rxStart], c->rxEnd - c->rxStart, &TransportProcessor::tokenHandler, c->protocol);
+    if (c->rxStart == c->rxEnd)
+    {
+        c->rxStart = 0;                         // all consumed; start from the beginning of the region again
+        c->rxEnd = 0;
+    }
     _pNum++;
     TRC(F("Tokenizer done ..." CR));
 }
-
+/**
+ * @brief Reads what is available on the incomming TCP stream directly into the receive region of the connection 
+ * and hands it over to the protocol handler.
+ * 
+ * @param c    Pointer to the connection struct contining relevant information handling the data from that connection
+ * @param max  maximum number of bytes to read
+ */
+int TransportProcessor::readStream(Connection *c, int max)
+{
+    uint32_t at = micros();
+    int space = reserve(c);
+    int len = c->client->read((uint8_t *) &c->rx[c->rxEnd], min(max, space)); // count is the amount of data ready for reading, -1 if there is no data, 0 is the connection has been closed
+    if (len <= 0) {
+        return 0;
+    }
+    scan(c, len, at);
+    return len;
+}
@@ -23,6 +23,7 @@
 
 #include "NetworkSetup.h"
 #include "WifiSetup.h"
+#include "LinkMonitor.h"
 
 bool WifiSetup::setup() {
  
@@ -30,6 +31,7 @@ bool WifiSetup::setup() {
      * @todo : set the ssid / pwd somewhere else / make it configurable
      * 
      */
+    LinkMonitor::setup();
     WiFi.begin(DCC_SSID,DCC_WPWD);
 
     maxConnections = MAX_WIFI_SOCK;
@@ -41,13 +43,24 @@ bool WifiSetup::setup() {
     }
 
     INFO(F("Waiting for connection to WiFi ... " CR));
+    uint32_t start = millis();
     while (WiFi.status() != WL_CONNECTED)
     {
+        if (millis() - start > WIFI_CONNECT_TIMEOUT)
+        {
+            // don't block the other transports; the servers will be started once the LinkMonitor sees the link
+            WARN(F("No WiFi connection yet; continuing without" CR));
+            break;
+        }
         delay(1000);
         TRC(F("." CR));
     }
     
-    INFO(F("Network Protocol: [%s]" CR), protocol ? "UDP" : "TCP");
+    // modem sleep is on by default and delays every packet recieved until the next DTIM beacon
+    WiFi.setSleep(profile == THROUGHPUT);
+    INFO(F("WiFi modem sleep: [%s]" CR), profile == THROUGHPUT ? "on" : "off");
+
+    INFO(F("Network Protocol: [%s]" CR), protocol == MQTT ? "MQTT" : protocol ? "UDP" : "TCP");
 
     // Setup the protocol handler
     switch (protocol)
@@ -72,8 +85,7 @@ bool WifiSetup::setup() {
     };
     case TCP:
     {
-        server = new WiFiServer(port);
-        server->begin(MAX_WIFI_SOCK, 240);
+        server = startServer(port);
         connected = true;
         /* No checks as it seems for the server */
         // if(server->status()) {
@@ -85,8 +97,12 @@ bool WifiSetup::setup() {
         // } // Connection pool not used for WiFi
         break;
     };
-    case MQTT: {
-        // do the MQTT setup stuff here 
+    case MQTT: 
+    {
+        // no server; the transport connects to the broker and the remote clients are mapped to the slots
+        maxConnections = MAX_SOCK_NUM;
+        connected = true;
+        break;
     };
     default:
     {
@@ -110,6 +126,18 @@ bool WifiSetup::setup() {
 
 };
 
+/**
+ * @brief bound to the address of the WiFi interface; see EthernetSetup::startServer
+ */
+WiFiServer *WifiSetup::startServer(uint16_t p) {
+    IPAddress ip = LinkMonitor::localIP(WIFI);
+    WiFiServer *s = new WiFiServer(ip, p, MAX_WIFI_SOCK);
+    if ((uint32_t) ip != 0) {
+        s->begin();
+    }
+    return s;
+}
+
 WifiSetup::WifiSetup() {}
-WifiSetup::WifiSetup(uint16_t p, protocolType pt ) { port = p; protocol = pt; }
+WifiSetup::WifiSetup(uint16_t p, protocolType pt, transportProfile tp ) { port = p; protocol = pt; profile = tp; }
 WifiSetup::~WifiSetup() {}
\ No newline at end of file
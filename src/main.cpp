@@ -21,6 +21,9 @@
 
 #include <NetworkInterface.h>
 #include <DccExInterface.h>
+#include <LinkBenchmark.h>
+#include <SpiLink.h>
+#include <I2cLink.h>
 #include <DCSIlog.h>
 #include <DCSIconfig.h>
 #include <DCSIDisplay.h>
@@ -33,6 +36,7 @@ void displayIntro();
 // (0) Declare NetworkInterfaces
 NetworkInterface nwi1;
 NetworkInterface nwi2;
+NetworkInterface nwi3;    // MQTT; see the setup below
 
 // (1) Declare CommandstationInterface. no error checking for multiple of those yet here can only be one maybe two 
 // in the future if multipe serial ports may be possible to create // connections if the com is getting the bottleneck
@@ -70,16 +74,28 @@ void setup()
   INFO(F("Opening Connection to the CommandStation ..." CR));
   // create the connection to the Command station
   DCCI.setup(_NWSTA);  // set up as Network station just use the default values
+  // DCCI.addLink(new UartLink(&Serial2));        // a second UART used together with Serial1; to be added before setup()
+  // DCCI.setup(_NWSTA, new SpiLink());              // or over SPI / I2C with the CommandStation as bus master
+  // DCCI.setup(_NWSTA, new I2cLink(), 400000);
 
 
   // open the connection to the "outside world" over Ethernet (cabled) or WiFi (wireless) 
   // nwi1.setup(ETHERNET, UDPR);                    // ETHERNET/UDP on Port 2560 
   // nwi2.setup(ETHERNET, UDPR, 8888);              // ETHERNET/UDP on Port 8888 
-  nwi1.setup(ETHERNET, TCP);                        // ETHERNET/TCP on Port 2560 
+  nwi1.listen(LISTEN_PORT, DCCEX);                  // DCC-EX commands on Port 2560
+  nwi1.listen(WITHROTTLE_PORT, WITHROTTLE);         // WiThrottle on Port 12090
+  // nwi1.listen(HTTP_PORT, HTTP);                  // HTTP on Port 80
+  // nwi1.multicast();                            // layout state updates to the group MCAST_GROUP:MCAST_PORT
+  nwi1.setup(ETHERNET, TCP);                        // ETHERNET/TCP on the Ports above; all share the same connection pool 
+  nwi2.listen(LISTEN_PORT, DCCEX);                  // same Ports on WiFi; runs side by side with Ethernet so that clients
+  nwi2.listen(WITHROTTLE_PORT, WITHROTTLE);         // can reconnect over WiFi if the Ethernet link is lost
+  nwi2.setup(WIFI, TCP);                            // WIFI/TCP
   // nwi2.setup(ETHERNET, TCP, 23);                 // ETHERNET/TCP on Port 23 for the CLI
+  // nwi3.setup(WIFI, MQTT, MQTT_PORT);            // MQTT over WiFi with the broker MQTT_BROKER:1883 (Config.h)
   // nwi1.setup(ETHERNET, TCP, 8888);               // ETHERNET/TCP on Port 8888
-  // nwi2.setup(WIFI, TCP);                            // WIFI/TCP on Port 2560
   // nwi1.setHttpCallback(httpRequestHandler);      // HTTP callback
+  // DCCI.setBlocking(true);                        // one command at a time e.g. for programming track work
+  // LinkBenchmark::run(100);                       // compare the synchronous and the pipelined link mode
 
   INFO(F("Network Setup done ...\n"));
   INFO(F("Free RAM after network init: [%d]\n"),freeMemory());
@@ -94,11 +110,10 @@ void setup()
 // void doOnce(HardwareSerial *sp) {
 //     if(!done) {
 //       Serial.println("Sending test message to CS ...");
-//       MsgPack::str_t s = MsgPack::str_t("test");
 //         m.client = 10;
 //         m.mid = 101;
 //         m.p = 1;
-//         m.msg = s;
+//         m.set("test");
 //         m.sta = _NWSTA;
 //         MsgPacketizer::send(*sp, 0x34, m);
 //         done = true;
@@ -0,0 +1,368 @@
+/**
+ * @file Arduino.h
+ * @brief The part of the Arduino API the link code, ArduinoLog and MsgPacketizer use; for the native
+ * (host) build of [env:native] in platformio.ini, where both stations run in one process over a LoopbackLink.
+ * Flash strings are plain strings, time comes from the steady clock and the Serial ports print to stdout.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define A0 0
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// flash strings
+class __FlashStringHelper;
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+#define pgm_read_byte(p) (*(const uint8_t *) (p))
+#define pgm_read_word(p) (*(const uint16_t *) (p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncpy_P strncpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+
+// time
+inline unsigned long micros()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return (unsigned long) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+inline void delayMicroseconds(unsigned int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+inline void yield() {}
+
+// pins
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t)
+{
+    return LOW;
+}
+inline int analogRead(uint8_t)
+{
+    return rand() & 0x3FF;
+}
+inline long random(long max)
+{
+    return max > 0 ? rand() % max : 0;
+}
+inline long random(long min, long max)
+{
+    return min + random(max - min);
+}
+inline void randomSeed(unsigned long seed)
+{
+    srand(seed);
+}
+
+class String
+{
+private:
+    std::string s;
+
+public:
+    String(const char *c = "") : s(c != nullptr ? c : "") {}
+    String(const std::string &c) : s(c) {}
+    String(const __FlashStringHelper *c) : s(reinterpret_cast<const char *>(c)) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v, unsigned char base = DEC) : s(base == HEX ? toHex(v) : std::to_string(v)) {}
+    explicit String(unsigned int v, unsigned char base = DEC) : s(base == HEX ? toHex(v) : std::to_string(v)) {}
+    explicit String(long v, unsigned char base = DEC) : s(base == HEX ? toHex(v) : std::to_string(v)) {}
+    explicit String(unsigned long v, unsigned char base = DEC) : s(base == HEX ? toHex(v) : std::to_string(v)) {}
+    explicit String(double v, unsigned char decimals = 2)
+    {
+        char b[32];
+        snprintf(b, sizeof(b), "%.*f", decimals, v);
+        s = b;
+    }
+    static std::string toHex(unsigned long v)
+    {
+        char b[20];
+        snprintf(b, sizeof(b), "%lx", v);
+        return b;
+    }
+    const char *c_str() const {
+        return s.c_str();
+    }
+    unsigned int length() const {
+        return s.size();
+    }
+    bool reserve(unsigned int n) {
+        s.reserve(n);
+        return true;
+    }
+    bool concat(const String &o) {
+        s += o.s;
+        return true;
+    }
+    bool concat(const char *c, unsigned int n) {
+        s.append(c, n);
+        return true;
+    }
+    bool concat(char c) {
+        s += c;
+        return true;
+    }
+    String &operator+=(const String &o) {
+        s += o.s;
+        return *this;
+    }
+    String &operator+=(const char *c) {
+        s += c;
+        return *this;
+    }
+    String &operator+=(char c) {
+        s += c;
+        return *this;
+    }
+    char operator[](unsigned int i) const {
+        return i < s.size() ? s[i] : 0;
+    }
+    char &operator[](unsigned int i) {
+        return s[i];
+    }
+    bool operator==(const String &o) const {
+        return s == o.s;
+    }
+    bool operator!=(const String &o) const {
+        return s != o.s;
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        return String(s.substr(from, to - from));
+    }
+    String substring(unsigned int from) const {
+        return String(s.substr(from));
+    }
+    int indexOf(char c) const {
+        size_t i = s.find(c);
+        return i == std::string::npos ? -1 : (int) i;
+    }
+    int toInt() const {
+        return atoi(s.c_str());
+    }
+};
+
+class Print;
+
+class Printable
+{
+public:
+    virtual size_t printTo(Print &p) const = 0;
+    virtual ~Printable() {}
+};
+
+class Print
+{
+private:
+    size_t number(unsigned long v, int base)
+    {
+        char b[8 * sizeof(long) + 1];
+        char *c = &b[sizeof(b) - 1];
+        *c = 0;
+        base = base < 2 ? DEC : base;
+        do
+        {
+            unsigned long d = v % base;
+            *--c = d < 10 ? '0' + d : 'A' + d - 10;
+            v /= base;
+        } while (v > 0);
+        return write(c);
+    }
+
+public:
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (n < size && write(buffer[n]) == 1)
+        {
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char *c) {
+        return c == nullptr ? 0 : write((const uint8_t *) c, strlen(c));
+    }
+    size_t write(const char *c, size_t size) {
+        return write((const uint8_t *) c, size);
+    }
+    virtual int availableForWrite() {
+        return 0;
+    }
+    virtual void flush() {}
+    virtual ~Print() {}
+
+    size_t print(const __FlashStringHelper *c) {
+        return write(reinterpret_cast<const char *>(c));
+    }
+    size_t print(const String &c) {
+        return write(c.c_str());
+    }
+    size_t print(const char *c) {
+        return write(c);
+    }
+    size_t print(char c) {
+        return write((uint8_t) c);
+    }
+    size_t print(unsigned char v, int base = DEC) {
+        return number(v, base);
+    }
+    size_t print(int v, int base = DEC) {
+        return print((long) v, base);
+    }
+    size_t print(unsigned int v, int base = DEC) {
+        return number(v, base);
+    }
+    size_t print(long v, int base = DEC)
+    {
+        if (base == DEC && v < 0)
+        {
+            return write('-') + number(-(unsigned long) v, DEC);
+        }
+        return number((unsigned long) v, base);
+    }
+    size_t print(unsigned long v, int base = DEC) {
+        return number(v, base);
+    }
+    size_t print(double v, int decimals = 2)
+    {
+        char b[32];
+        snprintf(b, sizeof(b), "%.*f", decimals, v);
+        return write(b);
+    }
+    size_t print(const Printable &p) {
+        return p.printTo(*this);
+    }
+    size_t println() {
+        return write("\r\n");
+    }
+    template <typename T>
+    size_t println(const T &v) {
+        return print(v) + println();
+    }
+    template <typename T>
+    size_t println(const T &v, int f) {
+        return print(v, f) + println();
+    }
+    size_t printf(const char *format, ...)
+    {
+        char b[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(b, sizeof(b), format, args);
+        va_end(args);
+        return write(b);
+    }
+};
+
+class Stream : public Print
+{
+protected:
+    unsigned long timeout = 1000;
+
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long ms) {
+        timeout = ms;
+    }
+    size_t readBytes(uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        int c;
+        while (n < size && (c = read()) >= 0)
+        {
+            buffer[n++] = c;
+        }
+        return n;
+    }
+    size_t readBytes(char *buffer, size_t size) {
+        return readBytes((uint8_t *) buffer, size);
+    }
+};
+
+/**
+ * @brief prints to stdout and never recieves anything
+ */
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long) {}
+    void end() {}
+    int available() override {
+        return 0;
+    }
+    int read() override {
+        return -1;
+    }
+    int peek() override {
+        return -1;
+    }
+    size_t write(uint8_t b) override {
+        return fputc(b, stdout) == EOF ? 0 : 1;
+    }
+    using Print::write;
+    void flush() override {
+        fflush(stdout);
+    }
+    operator bool() const {
+        return true;
+    }
+};
+
+static HardwareSerial Serial;
+static HardwareSerial Serial1;
+static HardwareSerial Serial2;
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file StringFormatter.h
+ * @brief Stands in for the StringFormatter of the CommandStation in the native build; DCSILog derives from it
+ * and the diagnostics take FSH format strings
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#ifndef StringFormatter_h
+#define StringFormatter_h
+
+#include <Arduino.h>
+
+#define FSH __FlashStringHelper
+
+class StringFormatter
+{
+};
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file test_main.cpp
+ * @brief runs two DccExInterfaces in one process over a pair of LoopbackLinks, one set up as the NetworkStation
+ * and one as the CommandStation: the epoch handshake, commands in order to the CS, the replies back with the mid
+ * of their command and an urgent stop. Run with `pio test -e native`
+ *
+ * The native env builds the CommandStation side (DCCI_CS) only, so both interfaces run its code; what only the
+ * NetworkStation has (client FairQueue, Correlator, mayWrite() / blocking, StateMirror, reply routing to the
+ * transports) isn't covered here. The LinkNegotiator is static and shared by both interfaces; it is set up
+ * without negotiation and the test checks it never becomes active.
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "DccExInterface.h"
+
+static const int COMMANDS = 20;
+
+static LoopbackLink nsLink, csLink;
+static DccExInterface ns, cs;
+
+static char executed[COMMANDS + 2][MAX_MESSAGE_SIZE];   // commands in the order the CS got them
+static int nExecuted = 0;
+static int replyRid[COMMANDS + 2];                      // mids the replies on the NS answer
+static int nReplies = 0;
+static int stops = 0;
+
+static void csCommand(DccExInterface &dcci, DccMessage m)
+{
+    if (strcmp(m.msg, "<!>") == 0)
+    {
+        stops++;
+        return;
+    }
+    if (nExecuted < COMMANDS + 2)
+    {
+        strncpy(executed[nExecuted++], m.msg, MAX_MESSAGE_SIZE - 1);
+    }
+    char reply[MAX_MESSAGE_SIZE];
+    snprintf(reply, sizeof(reply), "<r %.48s>", m.msg);
+    dcci.queue(m.client, _REPLY, reply, m.mid);
+}
+static void nsReply(DccExInterface &dcci, DccMessage m)
+{
+    if (nReplies < COMMANDS + 2)
+    {
+        replyRid[nReplies++] = m.rid;
+    }
+}
+/**
+ * @brief runs both stations for ms milliseconds or until done() holds
+ */
+template <typename T>
+static bool run(unsigned long ms, T done)
+{
+    unsigned long start = millis();
+    while (millis() - start < ms)
+    {
+        ns.loop();
+        cs.loop();
+        TEST_ASSERT_FALSE(LinkNegotiator::isActive());
+        if (done())
+        {
+            return true;
+        }
+        delay(1);
+    }
+    return false;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_handshake()
+{
+    TEST_ASSERT_TRUE(run(2000, []() { return ns.isSynced() && cs.isSynced(); }));
+}
+void test_commands_in_order()
+{
+    static int queued = 0;
+    TEST_ASSERT_TRUE(run(5000, []() {
+        while (queued < COMMANDS && !ns.isFull(1))   // the lanes are short; queue as they drain
+        {
+            char cmd[MAX_MESSAGE_SIZE];
+            snprintf(cmd, sizeof(cmd), "<T %d 1>", queued++);   // accessories; one lane so the order is the order queued
+            ns.queue(1, _DCCEX, cmd);
+        }
+        return nReplies == COMMANDS;
+    }));
+    TEST_ASSERT_EQUAL_INT(COMMANDS, nExecuted);
+    for (int i = 0; i < COMMANDS; i++)
+    {
+        char cmd[MAX_MESSAGE_SIZE];
+        snprintf(cmd, sizeof(cmd), "<T %d 1>", i);
+        TEST_ASSERT_EQUAL_STRING(cmd, executed[i]);
+    }
+    // the mids are numbered from the start of the epoch in the order send
+    for (int i = 1; i < COMMANDS; i++)
+    {
+        TEST_ASSERT_EQUAL_INT(1, (uint16_t) (replyRid[i] - replyRid[i - 1]));
+    }
+}
+void test_urgent()
+{
+    char stop[] = "<!>";
+    ns.urgent(1, _DCCEX, stop, micros());
+    TEST_ASSERT_TRUE(run(2000, []() { return stops > 0; }));
+    run(100, []() { return false; });                    // a resend because of a lost acknowledgement isn't executed
+    TEST_ASSERT_EQUAL_INT(1, stops);
+}
+
+int main(int argc, char **argv)
+{
+    nsLink.connect(&csLink);
+    ns.setHandler(_REPLY, nsReply);
+    cs.setHandler(_DCCEX, csCommand);
+    ns.setup(_NWSTA, &nsLink);
+    cs.setup(_DCCSTA, &csLink);
+    LinkNegotiator::setup(&nsLink, 0, false);   // each setup() sets up the shared negotiator; a loopback has no speed to step
+
+    UNITY_BEGIN();
+    RUN_TEST(test_handshake);
+    RUN_TEST(test_commands_in_order);
+    RUN_TEST(test_urgent);
+    return UNITY_END();
+}
@@ -0,0 +1,112 @@
+/**
+ * @file test_main.cpp
+ * @brief the queues of Queue.h on the host: the priority lanes, the weighted round robin of the client queues of 
+ * the NetworkStation and the single producer single consumer ring of the links. Run with `pio test -e native`
+ *
+ * This is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the GNU General Public License for more details <https://www.gnu.org/licenses/>
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+#include "Queue.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_lanes_by_priority()
+{
+    static const size_t caps[3] = {1, 2, 2};
+    LaneQueue<int, 3, 5> q(caps);
+    q.push(2, 20);
+    q.push(1, 10);
+    q.push(0, 1);
+    q.push(2, 21);
+    TEST_ASSERT_TRUE(q.isFull(0));
+    TEST_ASSERT_EQUAL_INT(1, q.pop());
+    TEST_ASSERT_EQUAL_INT(10, q.pop());
+    TEST_ASSERT_EQUAL_INT(20, q.pop());
+    TEST_ASSERT_EQUAL_INT(1, q.clear(2));
+    TEST_ASSERT_TRUE(q.isEmpty());
+}
+void test_fair_round_robin()
+{
+    FairQueue<int, 4, 8> q;
+    for (int i = 0; i < 4; i++)
+    {
+        q.push(1, 100 + i);
+        q.push(2, 200 + i);
+    }
+    int order[8];
+    int n = 0;
+    q.drain([&](int &e) { order[n++] = e; return true; });
+    TEST_ASSERT_EQUAL_INT(2, n);                        // one of each client per round
+    TEST_ASSERT_EQUAL_INT(100, order[0]);
+    TEST_ASSERT_EQUAL_INT(200, order[1]);
+}
+void test_fair_weight_kept()
+{
+    FairQueue<int, 2, 8> q;
+    TEST_ASSERT_TRUE(q.setWeight(7, 3));
+    q.push(7, 1);
+    q.drain([](int &) { return true; });                // the sub-queue of 7 is empty now
+    q.push(8, 1);                                       // takes the unused one
+    q.drain([](int &) { return true; });
+    q.push(9, 1);                                       // both used and empty; takes one over
+    q.push(10, 1);
+    q.drain([](int &) { return true; });
+    for (int i = 0; i < 5; i++)
+    {
+        q.push(7, i);                                   // 7 gets a sub-queue again
+    }
+    int n = 0;
+    q.drain([&](int &) { n++; return true; });
+    TEST_ASSERT_EQUAL_INT(3, n);
+}
+void test_fair_refused_stays()
+{
+    FairQueue<int, 2, 8> q;
+    q.setWeight(1, 4);
+    q.push(1, 1);
+    q.push(1, 2);
+    q.push(1, 3);
+    int n = 0;
+    q.drain([&](int &e) { n += e != 2; return e != 2; });
+    TEST_ASSERT_EQUAL_INT(2, n);                        // the one after the refused one still goes
+    TEST_ASSERT_EQUAL_INT(1, q.size(1));
+    int left = 0;
+    q.drain([&](int &e) { left = e; return true; });
+    TEST_ASSERT_EQUAL_INT(2, left);
+}
+void test_spsc_wraps()
+{
+    SpscQueue<int, 4> q;
+    int v = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        TEST_ASSERT_TRUE(q.push(i));
+        TEST_ASSERT_TRUE(q.peek(v));
+        TEST_ASSERT_TRUE(q.pop(v));
+        TEST_ASSERT_EQUAL_INT(i, v);
+    }
+    while (q.push(v))
+    {
+    }
+    TEST_ASSERT_TRUE(q.isFull());
+    TEST_ASSERT_FALSE(q.pop(v) && q.isFull());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_lanes_by_priority);
+    RUN_TEST(test_fair_round_robin);
+    RUN_TEST(test_fair_weight_kept);
+    RUN_TEST(test_fair_refused_stays);
+    RUN_TEST(test_spsc_wraps);
+    return UNITY_END();
+}